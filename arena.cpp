@@ -0,0 +1,84 @@
+#include "arena.hpp"
+#include <cstdlib>
+#include <assert.h>
+
+/****** Arena Implementation **************************************/
+
+// each thread builds its own trees
+static thread_local Arena* current_arena = NULL;
+
+Arena::Arena(size_t chunk_size)
+{
+	m_chunks = NULL;
+	m_next = m_end = NULL;
+	m_chunk_size = chunk_size;
+	m_bytes = 0;
+	m_count = 0;
+}
+
+Arena::~Arena()
+{
+	release();
+	if ( current_arena == this ) current_arena = NULL;
+}
+
+void Arena::new_chunk(size_t min_size)
+{
+	//oversized requests get a chunk of their own
+	size_t size = (min_size > m_chunk_size) ? min_size : m_chunk_size;
+	Chunk* c = (Chunk*)malloc(sizeof(Chunk) + size);
+	assert( c != NULL );
+	c->next = m_chunks;
+	c->size = size;
+	m_chunks = c;
+	m_next = (char*)(c+1);
+	m_end = m_next + size;
+}
+
+void* Arena::allocate(size_t size, size_t align)
+{
+	//align must be a power of two
+	size_t pad = (align - ((size_t)m_next & (align-1))) & (align-1);
+	if ( m_next == NULL || pad + size > (size_t)(m_end - m_next) ) {
+		new_chunk(size + align);
+		pad = (align - ((size_t)m_next & (align-1))) & (align-1);
+	}
+	void* r = m_next + pad;
+	m_next += pad + size;
+	m_bytes += size;
+	m_count++;
+	return r;
+}
+
+void Arena::release()
+{
+	while ( m_chunks != NULL ) {
+		Chunk* next = m_chunks->next;
+		free(m_chunks);
+		m_chunks = next;
+	}
+	m_next = m_end = NULL;
+	m_bytes = 0;
+	m_count = 0;
+}
+
+size_t Arena::bytes_allocated()
+{
+	return m_bytes;
+}
+
+size_t Arena::allocation_count()
+{
+	return m_count;
+}
+
+Arena* Arena::current()
+{
+	assert( current_arena != NULL );
+	return current_arena;
+}
+
+void Arena::set_current(Arena* a)
+{
+	current_arena = a;
+}
@@ -0,0 +1,106 @@
+#ifndef ARENA_HPP
+#define ARENA_HPP
+
+#include <cstddef>
+#include <iterator>
+
+// A bump allocator for everything that lives exactly as long as one
+// compilation (the syntax tree and its child lists).  Memory is carved
+// out of large chunks and is never handed back piecemeal; release()
+// (or the destructor) frees every chunk at once.  Destructors of the
+// objects placed in an arena are not run.
+class Arena
+{
+  struct Chunk
+  {
+    Chunk* next;
+    size_t size;
+  };
+
+  Chunk* m_chunks;   // most recently allocated chunk first
+  char* m_next;      // first free byte of the current chunk
+  char* m_end;       // one past the last byte of the current chunk
+  size_t m_chunk_size;
+
+  size_t m_bytes;    // bytes handed out since the last release
+  size_t m_count;    // allocations since the last release
+
+  Arena(const Arena &);
+  Arena &operator=(const Arena &);
+
+  void new_chunk(size_t min_size);
+
+  public:
+
+  Arena(size_t chunk_size = 64 * 1024);
+  ~Arena();
+
+  void* allocate(size_t size, size_t align = sizeof(void*) * 2);
+  void release();
+
+  size_t bytes_allocated();
+  size_t allocation_count();
+
+  //the arena that AST nodes are currently being allocated from
+  //(set by the driver before the parse starts; there is one per thread)
+  static Arena* current();
+  static void set_current(Arena* a);
+};
+
+// The child lists of the syntax tree.  Elements are stored contiguously
+// in the arena that was current when the vector was created, so walking a
+// list is a linear scan instead of a pointer chase per element.  Growing
+// doubles the capacity and leaves the old storage behind in the arena
+// (it is reclaimed with everything else when the arena is released).
+// The vector object itself is also placed in the current arena.
+template <class T>
+class ArenaVector
+{
+  T* m_data;
+  size_t m_size;
+  size_t m_capacity;
+  Arena* m_arena;
+
+  void grow()
+  {
+    size_t capacity = (m_capacity == 0) ? 4 : m_capacity * 2;
+    T* data = (T*)m_arena->allocate(capacity * sizeof(T));
+    for( size_t i=0; i<m_size; i++ ) data[i] = m_data[i];
+    m_data = data;
+    m_capacity = capacity;
+  }
+
+  public:
+  typedef T value_type;
+  typedef T* iterator;
+  typedef const T* const_iterator;
+  typedef std::reverse_iterator<T*> reverse_iterator;
+  typedef std::reverse_iterator<const T*> const_reverse_iterator;
+
+  ArenaVector() { m_data = NULL; m_size = m_capacity = 0; m_arena = Arena::current(); }
+
+  static void* operator new(size_t size) { return Arena::current()->allocate(size); }
+  static void operator delete(void*) {}
+
+  void push_back(const T & x)
+  {
+    if ( m_size == m_capacity ) grow();
+    m_data[m_size++] = x;
+  }
+
+  size_t size() const { return m_size; }
+  bool empty() const { return m_size == 0; }
+
+  T & operator[](size_t i) { return m_data[i]; }
+  T & front() { return m_data[0]; }
+  T & back() { return m_data[m_size-1]; }
+
+  iterator begin() { return m_data; }
+  iterator end() { return m_data + m_size; }
+  const_iterator begin() const { return m_data; }
+  const_iterator end() const { return m_data + m_size; }
+  reverse_iterator rbegin() { return reverse_iterator(end()); }
+  reverse_iterator rend() { return reverse_iterator(begin()); }
+};
+
+#endif //ARENA_HPP
@@ -0,0 +1,753 @@
+#include "assembler.hpp"
+#include <elf.h>
+#include <algorithm>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+static std::string trim(const std::string & s)
+{
+	size_t b = s.find_first_not_of(" \t");
+	if ( b == std::string::npos ) return "";
+	size_t e = s.find_last_not_of(" \t");
+	return s.substr(b, e-b+1);
+}
+
+static bool fits8(long long v) { return v >= -128 && v <= 127; }
+static bool fits32(long long v) { return v >= INT_MIN && v <= INT_MAX; }
+
+//the number of a register and its size in bits (8, 32 or 64)
+static bool reg_lookup(const std::string & n, int & num, int & size)
+{
+	static const char* r32[8] = { "eax", "ecx", "edx", "ebx", "esp", "ebp", "esi", "edi" };
+	static const char* r64[8] = { "rax", "rcx", "rdx", "rbx", "rsp", "rbp", "rsi", "rdi" };
+	static const char* r8[8] = { "al", "cl", "dl", "bl", "spl", "bpl", "sil", "dil" };
+	for( int k=0; k<8; k++ ) {
+		if ( n == r32[k] ) { num = k; size = 32; return true; }
+		if ( n == r64[k] ) { num = k; size = 64; return true; }
+		if ( n == r8[k] ) { num = k; size = 8; return true; }
+	}
+
+	//%r8 .. %r15, with a d (32 bit) or b (8 bit) suffix
+	if ( n.size() < 2 || n[0] != 'r' || !isdigit((unsigned char)n[1]) ) return false;
+	char* end;
+	num = (int)strtol(n.c_str()+1, &end, 10);
+	if ( num < 8 || num > 15 ) return false;
+	if ( *end == '\0' ) size = 64;
+	else if ( strcmp(end, "d") == 0 ) size = 32;
+	else if ( strcmp(end, "b") == 0 ) size = 8;
+	else return false;
+	return true;
+}
+
+//a number, a symbol, or a symbol plus or minus a number
+static bool parse_value(const std::string & s, long long & value, std::string & symbol)
+{
+	value = 0;
+	symbol.clear();
+	if ( s.empty() ) return true;
+
+	size_t k = 0;
+	if ( !isdigit((unsigned char)s[0]) && s[0] != '-' && s[0] != '+' ) {
+		while ( k < s.size() && (isalnum((unsigned char)s[k]) || s[k] == '_' || s[k] == '.' || s[k] == '@') ) k++;
+		symbol = s.substr(0, k);
+		if ( symbol.empty() ) return false;
+		if ( k == s.size() ) return true;
+	}
+	char* end;
+	value = strtoll(s.c_str()+k, &end, 0);
+	return end != s.c_str()+k && *end == '\0';
+}
+
+//the condition code of a jcc or setcc suffix, -1 if there is none
+static int condition(const std::string & c)
+{
+	static const struct { const char* name; int cc; } conds[] = {
+		{ "o", 0 }, { "no", 1 }, { "b", 2 }, { "c", 2 }, { "nae", 2 },
+		{ "ae", 3 }, { "nb", 3 }, { "nc", 3 }, { "e", 4 }, { "z", 4 },
+		{ "ne", 5 }, { "nz", 5 }, { "be", 6 }, { "na", 6 }, { "a", 7 },
+		{ "nbe", 7 }, { "s", 8 }, { "ns", 9 }, { "p", 10 }, { "pe", 10 },
+		{ "np", 11 }, { "po", 11 }, { "l", 12 }, { "nge", 12 }, { "ge", 13 },
+		{ "nl", 13 }, { "le", 14 }, { "ng", 14 }, { "g", 15 }, { "nle", 15 } };
+	for( size_t k=0; k<sizeof(conds)/sizeof(conds[0]); k++ ) {
+		if ( c == conds[k].name ) return conds[k].cc;
+	}
+	return -1;
+}
+
+/****** Assembler Implementation **************************************/
+
+Assembler::Assembler(Target target)
+{
+	m_target = target;
+}
+
+void Assembler::fail(const std::string & line, const char* what)
+{
+	if ( m_error.empty() ) m_error = std::string(what) + ": " + trim(line);
+}
+
+//target: a bare name is a jump or call target rather than a memory
+//operand at that (absolute) address
+bool Assembler::parse_operand(const std::string & s, Operand & o, bool target)
+{
+	o.reg_num = -1;
+	o.size = 0;
+	o.rip = false;
+	o.value = 0;
+	o.plt = false;
+	o.symbol.clear();
+	if ( s.empty() ) return false;
+
+	bool x64 = (m_target == tg_x86_64);
+	if ( s[0] == '%' ) {
+		o.kind = Operand::reg;
+		if ( !reg_lookup(s.substr(1), o.reg_num, o.size) ) return false;
+		//i386 has neither the new registers nor %spl..%dil
+		return x64 || (o.size != 64 && o.reg_num < ((o.size == 8) ? 4 : 8));
+	}
+
+	if ( s[0] == '$' ) {
+		o.kind = Operand::imm;
+		return parse_value(s.substr(1), o.value, o.symbol);
+	}
+
+	size_t paren = s.find('(');
+	if ( paren == std::string::npos ) {
+		if ( !parse_value(s, o.value, o.symbol) ) return false;
+		if ( target ) {
+			o.kind = Operand::sym;
+			size_t at = o.symbol.find('@');
+			if ( at != std::string::npos ) {
+				if ( o.symbol.substr(at) != "@PLT" ) return false;
+				o.symbol.erase(at);
+				o.plt = true;
+			}
+			return !o.symbol.empty();
+		}
+		o.kind = Operand::mem;
+		return fits32(o.value) && o.symbol.find('@') == std::string::npos;
+	}
+
+	//disp(%base); there is no index register in anything we emit
+	o.kind = Operand::mem;
+	if ( target || s[s.size()-1] != ')' ) return false;
+	if ( !parse_value(s.substr(0, paren), o.value, o.symbol) || !fits32(o.value) ) return false;
+	std::string base = s.substr(paren+1, s.size()-paren-2);
+	if ( base == "%rip" ) {
+		o.rip = true;
+		return x64;
+	}
+	int size;
+	if ( base.empty() || base[0] != '%' || !reg_lookup(base.substr(1), o.reg_num, size) ) return false;
+	return size == (x64 ? 64 : 32);
+}
+
+void Assembler::directive(const std::string & text)
+{
+	std::string t = trim(text);
+	if ( t.empty() || t[0] == '#' ) return;
+
+	size_t sp = t.find_first_of(" \t");
+	std::string name = t.substr(0, sp);
+	std::string rest = (sp == std::string::npos) ? "" : trim(t.substr(sp));
+
+	if ( name == ".text" ) {
+		//everything goes into .text anyway
+	} else if ( name == ".section" ) {
+		//the only other section is the note write() always adds
+		if ( rest.compare(0, 15, ".note.GNU-stack") != 0 ) fail(text, "unknown section");
+	} else if ( name == ".globl" || name == ".global" ) {
+		for( size_t k=0; k<m_globals.size(); k++ ) {
+			if ( m_globals[k] == rest ) return;
+		}
+		m_globals.push_back(rest);
+	} else if ( name == ".type" ) {
+		size_t comma = rest.find(',');
+		if ( comma != std::string::npos && trim(rest.substr(comma+1)) == "@function" ) {
+			m_functions[trim(rest.substr(0, comma))] = true;
+		}
+	} else if ( name == ".comm" ) {
+		//.comm name,size,align
+		size_t c1 = rest.find(',');
+		size_t c2 = (c1 == std::string::npos) ? c1 : rest.find(',', c1+1);
+		if ( c2 == std::string::npos ) {
+			fail(text, "bad .comm");
+			return;
+		}
+		Common c;
+		c.name = trim(rest.substr(0, c1));
+		c.size = atoi(rest.substr(c1+1, c2-c1-1).c_str());
+		c.align = atoi(rest.substr(c2+1).c_str());
+		m_common.push_back(c);
+	} else if ( name == ".string" || name == ".asciz" ) {
+		if ( rest.size() < 2 || rest[0] != '"' || rest[rest.size()-1] != '"' ) {
+			fail(text, "bad string");
+			return;
+		}
+		for( size_t k=1; k+1<rest.size(); k++ ) {
+			char c = rest[k];
+			if ( c == '\\' && k+2 < rest.size() ) {
+				c = rest[++k];
+				if ( c == 'n' ) c = '\n';
+				else if ( c == 't' ) c = '\t';
+				else if ( c >= '0' && c <= '7' ) {
+					int v = 0;
+					for( int d=0; d<3 && rest[k] >= '0' && rest[k] <= '7'; d++ ) v = v*8 + (rest[k++] - '0');
+					k--;
+					c = (char)v;
+				}
+			}
+			byte((unsigned char)c);
+		}
+		byte(0);
+	} else {
+		fail(text, "unknown directive");
+	}
+}
+
+void Assembler::imm(long long v, int bytes)
+{
+	for( int k=0; k<bytes; k++ ) byte((unsigned)((unsigned long long)v >> (8*k)) & 0xff);
+}
+
+//an immediate operand, possibly the address of a symbol
+void Assembler::immediate(const Operand & o, int bytes)
+{
+	if ( o.symbol.empty() ) imm(o.value, bytes);
+	else field(o.symbol, fx_abs32, o.value);
+}
+
+//a 32 bit field that refers to symbol; filled in by write()
+void Assembler::field(const std::string & symbol, FixupKind kind, long long addend)
+{
+	Fixup f;
+	f.offset = m_text.size();
+	f.symbol = symbol;
+	f.kind = kind;
+	f.addend = addend;
+	m_fixups.push_back(f);
+	imm(0, 4);
+}
+
+//the REX prefix, when one is needed: for 64 bit operands, for %r8..%r15,
+//and to get at %spl..%dil instead of %ah..%bh
+void Assembler::rex(bool w, int reg, const Operand & rm)
+{
+	unsigned r = 0x40;
+	if ( w ) r |= 8;
+	if ( reg >= 8 ) r |= 4;
+	if ( rm.kind != Operand::imm && rm.reg_num >= 8 ) r |= 1;
+	bool low_byte = (rm.kind == Operand::reg && rm.size == 8 && rm.reg_num >= 4);
+	if ( r != 0x40 || low_byte ) byte(r);
+}
+
+void Assembler::opcode(unsigned op)
+{
+	if ( op > 0xff ) byte(op >> 8);
+	byte(op & 0xff);
+}
+
+//the ModRM byte (and SIB and displacement) for reg and the register or
+//memory operand rm; imm_bytes follow the displacement, which a %rip
+//relative address has to allow for
+void Assembler::modrm(int reg, const Operand & rm, int imm_bytes)
+{
+	int r = (reg & 7) << 3;
+	if ( rm.kind == Operand::reg ) {
+		byte(0xc0 | r | (rm.reg_num & 7));
+		return;
+	}
+
+	if ( rm.rip ) {
+		byte(0x05 | r);
+		if ( rm.symbol.empty() ) imm(rm.value, 4);
+		else field(rm.symbol, fx_pc32, rm.value - 4 - imm_bytes);
+		return;
+	}
+
+	if ( rm.reg_num < 0 ) {
+		//an absolute address (x86-64 needs a SIB byte for it)
+		if ( m_target == tg_x86_64 ) {
+			byte(0x04 | r);
+			byte(0x25);
+		} else {
+			byte(0x05 | r);
+		}
+		immediate(rm, 4);
+		return;
+	}
+
+	int base = rm.reg_num & 7;
+	int mod;
+	if ( !rm.symbol.empty() ) mod = 2;
+	else if ( rm.value == 0 && base != 5 ) mod = 0; // (%ebp) has to be 0(%ebp)
+	else if ( fits8(rm.value) ) mod = 1;
+	else mod = 2;
+	byte((mod << 6) | r | base);
+	if ( base == 4 ) byte(0x24); // (%esp) needs a SIB byte
+	if ( mod == 1 ) imm(rm.value, 1);
+	else if ( mod == 2 ) immediate(rm, 4);
+}
+
+void Assembler::encode_rm(bool w, unsigned op, int reg, const Operand & rm, int imm_bytes)
+{
+	rex(w, reg, rm);
+	opcode(op);
+	modrm(reg, rm, imm_bytes);
+}
+
+bool Assembler::encode(const AsmInst & i)
+{
+	const std::string & op = i.op;
+	bool x64 = (m_target == tg_x86_64);
+
+	if ( i.nargs == 0 ) {
+		if ( op == "ret" ) byte(0xc3);
+		else if ( op == "leave" ) byte(0xc9);
+		else if ( op == "cdq" || op == "cltd" ) byte(0x99);
+		else if ( x64 && (op == "cqto" || op == "cqo") ) { byte(0x48); byte(0x99); }
+		else return false;
+		return true;
+	}
+
+	bool branch = (op == "call" || op[0] == 'j');
+	Operand a[2];
+	for( int k=0; k<i.nargs; k++ ) {
+		if ( !parse_operand(i.arg[k], a[k], branch) ) return false;
+	}
+	Operand & src = a[0];
+	Operand & dst = a[1];
+	int cc;
+
+	//jumps and calls always take a 32 bit displacement
+	if ( branch ) {
+		if ( i.nargs != 1 || src.kind != Operand::sym ) return false;
+		if ( op == "call" ) {
+			byte(0xe8);
+		} else if ( op == "jmp" ) {
+			byte(0xe9);
+		} else if ( (cc = condition(op.substr(1))) >= 0 ) {
+			byte(0x0f);
+			byte(0x80 + cc);
+		} else {
+			return false;
+		}
+		field(src.symbol, src.plt ? fx_plt32 : fx_pc32, src.value - 4);
+		return true;
+	}
+
+	if ( op.compare(0, 3, "set") == 0 && (cc = condition(op.substr(3))) >= 0 ) {
+		if ( i.nargs != 1 || src.kind == Operand::imm || (src.kind == Operand::reg && src.size != 8) ) return false;
+		encode_rm(false, 0x0f90 + cc, 0, src, 0);
+		return true;
+	}
+
+	if ( op == "movabsq" || op == "movabs" ) {
+		if ( !x64 || i.nargs != 2 || src.kind != Operand::imm || !src.symbol.empty() ||
+		     dst.kind != Operand::reg || dst.size != 64 ) return false;
+		rex(true, 0, dst);
+		byte(0xb8 + (dst.reg_num & 7));
+		imm(src.value, 8);
+		return true;
+	}
+
+	if ( op == "movzbl" || op == "movzbq" ) {
+		int size = (op == "movzbl") ? 32 : 64;
+		if ( i.nargs != 2 || dst.kind != Operand::reg || dst.size != size ) return false;
+		if ( src.kind == Operand::imm || (src.kind == Operand::reg && src.size != 8) ) return false;
+		encode_rm(size == 64, 0x0fb6, dst.reg_num, src, 0);
+		return true;
+	}
+
+	//the rest have an l or q suffix, or take the size of their registers
+	static const char* bases[] = {
+		"add", "or", "adc", "sbb", "and", "sub", "xor", "cmp", // the ALU group, in opcode order
+		"mov", "test", "imul", "idiv", "neg", "not", "inc", "dec", "lea", "push", "pop" };
+	static const int num_bases = sizeof(bases)/sizeof(bases[0]);
+	std::string base = op;
+	int size = 0;
+	int b;
+	for( b=0; b<num_bases && base != bases[b]; b++ );
+	if ( b == num_bases ) {
+		char last = op[op.size()-1];
+		if ( last != 'l' && last != 'q' ) return false;
+		base = op.substr(0, op.size()-1);
+		size = (last == 'l') ? 32 : 64;
+		for( b=0; b<num_bases && base != bases[b]; b++ );
+		if ( b == num_bases ) return false;
+	}
+	for( int k=0; k<i.nargs; k++ ) {
+		if ( a[k].kind != Operand::reg ) continue;
+		if ( size == 0 ) size = a[k].size;
+		if ( a[k].size != size ) return false;
+	}
+	if ( size == 0 || (size == 64 && !x64) ) return false;
+	bool w = (size == 64);
+
+	//what an immediate of this operand size can hold (a 64 bit operation
+	//sign extends a 32 bit one)
+	if ( src.kind == Operand::imm && src.symbol.empty() ) {
+		//(except that a movq to a register can take all 64 bits)
+		bool big = w ? !fits32(src.value) : (src.value < INT_MIN || src.value > UINT_MAX);
+		if ( big && !(w && base == "mov" && dst.kind == Operand::reg) ) return false;
+		if ( !w ) src.value = (int)(unsigned)src.value;
+	}
+	bool short_imm = (src.kind == Operand::imm && src.symbol.empty() && fits8(src.value));
+
+	if ( b < 8 ) {
+		if ( i.nargs != 2 || dst.kind == Operand::imm ) return false;
+		if ( src.kind == Operand::imm ) {
+			encode_rm(w, short_imm ? 0x83 : 0x81, b, dst, short_imm ? 1 : 4);
+			immediate(src, short_imm ? 1 : 4);
+		} else if ( src.kind == Operand::reg ) {
+			encode_rm(w, b*8 + 1, src.reg_num, dst, 0);
+		} else if ( dst.kind == Operand::reg ) {
+			encode_rm(w, b*8 + 3, dst.reg_num, src, 0);
+		} else {
+			return false;
+		}
+	} else if ( base == "mov" ) {
+		if ( i.nargs != 2 || dst.kind == Operand::imm ) return false;
+		if ( src.kind == Operand::imm && dst.kind == Operand::reg && w && src.symbol.empty() && !fits32(src.value) ) {
+			rex(true, 0, dst);
+			byte(0xb8 + (dst.reg_num & 7));
+			imm(src.value, 8);
+		} else if ( src.kind == Operand::imm && dst.kind == Operand::reg && !w ) {
+			rex(false, 0, dst);
+			byte(0xb8 + (dst.reg_num & 7));
+			immediate(src, 4);
+		} else if ( src.kind == Operand::imm ) {
+			encode_rm(w, 0xc7, 0, dst, 4);
+			immediate(src, 4);
+		} else if ( src.kind == Operand::reg ) {
+			encode_rm(w, 0x89, src.reg_num, dst, 0);
+		} else if ( dst.kind == Operand::reg ) {
+			encode_rm(w, 0x8b, dst.reg_num, src, 0);
+		} else {
+			return false;
+		}
+	} else if ( base == "test" ) {
+		if ( i.nargs != 2 || dst.kind == Operand::imm ) return false;
+		if ( src.kind == Operand::imm ) {
+			encode_rm(w, 0xf7, 0, dst, 4);
+			immediate(src, 4);
+		} else if ( src.kind == Operand::reg ) {
+			encode_rm(w, 0x85, src.reg_num, dst, 0);
+		} else if ( dst.kind == Operand::reg ) {
+			encode_rm(w, 0x85, dst.reg_num, src, 0);
+		} else {
+			return false;
+		}
+	} else if ( base == "imul" ) {
+		if ( i.nargs != 2 || dst.kind != Operand::reg ) return false;
+		if ( src.kind == Operand::imm ) {
+			encode_rm(w, short_imm ? 0x6b : 0x69, dst.reg_num, dst, 0);
+			immediate(src, short_imm ? 1 : 4);
+		} else {
+			encode_rm(w, 0x0faf, dst.reg_num, src, 0);
+		}
+	} else if ( base == "lea" ) {
+		if ( i.nargs != 2 || src.kind != Operand::mem || dst.kind != Operand::reg ) return false;
+		encode_rm(w, 0x8d, dst.reg_num, src, 0);
+	} else if ( base == "push" || base == "pop" ) {
+		//always a whole word, and without REX.W on x86-64
+		if ( i.nargs != 1 || size != (x64 ? 64 : 32) ) return false;
+		bool push = (base == "push");
+		if ( src.kind == Operand::reg ) {
+			rex(false, 0, src);
+			byte((push ? 0x50 : 0x58) + (src.reg_num & 7));
+		} else if ( src.kind == Operand::imm ) {
+			if ( !push ) return false;
+			byte(short_imm ? 0x6a : 0x68);
+			immediate(src, short_imm ? 1 : 4);
+		} else if ( push ) {
+			encode_rm(false, 0xff, 6, src, 0);
+		} else {
+			encode_rm(false, 0x8f, 0, src, 0);
+		}
+	} else {
+		//idiv, neg, not, inc and dec: one register or memory operand
+		if ( i.nargs != 1 || src.kind == Operand::imm ) return false;
+		if ( base == "idiv" ) encode_rm(w, 0xf7, 7, src, 0);
+		else if ( base == "neg" ) encode_rm(w, 0xf7, 3, src, 0);
+		else if ( base == "not" ) encode_rm(w, 0xf7, 2, src, 0);
+		else if ( base == "inc" ) encode_rm(w, 0xff, 0, src, 0);
+		else encode_rm(w, 0xff, 1, src, 0);
+	}
+	return true;
+}
+
+void Assembler::assemble(const AsmInst & i)
+{
+	if ( i.kind == AsmInst::label ) {
+		if ( m_labels.count(i.op) ) {
+			fail(i.op, "label defined twice");
+			return;
+		}
+		m_labels[i.op] = m_text.size();
+		m_label_order.push_back(i.op);
+	} else if ( i.kind == AsmInst::other ) {
+		directive(i.text);
+	} else if ( !encode(i) ) {
+		std::string line = i.op;
+		for( int k=0; k<i.nargs; k++ ) line += ((k == 0) ? " " : ", ") + i.arg[k];
+		fail(line, "cannot encode");
+	}
+}
+
+/****** ELF output **************************************/
+
+//little endian, like both targets
+static void put(std::vector<unsigned char> & out, unsigned long long v, int bytes)
+{
+	for( int k=0; k<bytes; k++ ) out.push_back((unsigned char)(v >> (8*k)));
+}
+
+static void patch32(std::vector<unsigned char> & out, size_t at, long long v)
+{
+	for( int k=0; k<4; k++ ) out[at+k] = (unsigned char)((unsigned long long)v >> (8*k));
+}
+
+static void align(std::vector<unsigned char> & out, int a)
+{
+	while ( out.size() % a ) out.push_back(0);
+}
+
+static unsigned add_string(std::string & table, const std::string & s)
+{
+	unsigned at = table.size();
+	table += s;
+	table += '\0';
+	return at;
+}
+
+namespace {
+	struct ElfSym
+	{
+		unsigned name;
+		unsigned char info;
+		unsigned shndx;
+		unsigned long long value, size;
+	};
+
+	struct ElfRel
+	{
+		unsigned long long offset;
+		unsigned sym, type;
+		long long addend;
+	};
+
+	// the sections of the object, in order
+	enum { sec_null, sec_text, sec_rel, sec_note, sec_symtab, sec_strtab, sec_shstrtab, num_sections };
+}
+
+bool Assembler::write(OutputBuffer* out)
+{
+	if ( !m_error.empty() ) return false;
+	bool x64 = (m_target == tg_x86_64);
+	int word = x64 ? 8 : 4;
+
+	//the symbols: the .text section (for references to the .L labels),
+	//the other labels, then everything global
+	std::string strtab(1, '\0');
+	std::vector<ElfSym> syms;
+	std::map<std::string, unsigned> index;
+	ElfSym s = { 0, 0, SHN_UNDEF, 0, 0 };
+	syms.push_back(s);
+	s.info = ELF32_ST_INFO(STB_LOCAL, STT_SECTION);
+	s.shndx = sec_text;
+	syms.push_back(s);
+
+	std::map<std::string, bool> global;
+	for( size_t k=0; k<m_globals.size(); k++ ) global[m_globals[k]] = true;
+	for( size_t k=0; k<m_common.size(); k++ ) global[m_common[k].name] = true;
+
+	for( size_t k=0; k<m_label_order.size(); k++ ) {
+		const std::string & name = m_label_order[k];
+		if ( global.count(name) || name.compare(0, 2, ".L") == 0 ) continue;
+		ElfSym l = { add_string(strtab, name), ELF32_ST_INFO(STB_LOCAL, STT_NOTYPE), sec_text, m_labels[name], 0 };
+		index[name] = syms.size();
+		syms.push_back(l);
+	}
+	unsigned first_global = syms.size();
+
+	for( size_t k=0; k<m_globals.size(); k++ ) {
+		const std::string & name = m_globals[k];
+		std::map<std::string, size_t>::iterator l = m_labels.find(name);
+		ElfSym g = { add_string(strtab, name), ELF32_ST_INFO(STB_GLOBAL, STT_NOTYPE), SHN_UNDEF, 0, 0 };
+		if ( l != m_labels.end() ) {
+			if ( m_functions.count(name) ) g.info = ELF32_ST_INFO(STB_GLOBAL, STT_FUNC);
+			g.shndx = sec_text;
+			g.value = l->second;
+		}
+		index[name] = syms.size();
+		syms.push_back(g);
+	}
+	for( size_t k=0; k<m_common.size(); k++ ) {
+		const Common & c = m_common[k];
+		ElfSym g = { add_string(strtab, c.name), ELF32_ST_INFO(STB_GLOBAL, STT_OBJECT), SHN_COMMON,
+		             (unsigned long long)c.align, (unsigned long long)c.size };
+		if ( index.count(c.name) ) syms[index[c.name]] = g;
+		else {
+			index[c.name] = syms.size();
+			syms.push_back(g);
+		}
+	}
+
+	//resolve what refers to this object's own code, and turn the rest
+	//into relocations (against an undefined symbol for what is not here)
+	std::vector<unsigned char> text = m_text;
+	std::vector<ElfRel> rels;
+	for( size_t k=0; k<m_fixups.size(); k++ ) {
+		const Fixup & f = m_fixups[k];
+		std::map<std::string, size_t>::iterator l = m_labels.find(f.symbol);
+		if ( l != m_labels.end() && f.kind != fx_abs32 ) {
+			patch32(text, f.offset, (long long)l->second + f.addend - (long long)f.offset);
+			continue;
+		}
+
+		ElfRel r;
+		r.offset = f.offset;
+		r.addend = f.addend;
+		if ( l != m_labels.end() ) {
+			r.sym = 1;
+			r.addend += l->second;
+		} else {
+			if ( !index.count(f.symbol) ) {
+				ElfSym u = { add_string(strtab, f.symbol), ELF32_ST_INFO(STB_GLOBAL, STT_NOTYPE), SHN_UNDEF, 0, 0 };
+				index[f.symbol] = syms.size();
+				syms.push_back(u);
+			}
+			r.sym = index[f.symbol];
+		}
+		if ( x64 ) {
+			r.type = (f.kind == fx_pc32) ? R_X86_64_PC32 : (f.kind == fx_plt32) ? R_X86_64_PLT32 : R_X86_64_32S;
+		} else {
+			r.type = (f.kind == fx_pc32) ? R_386_PC32 : (f.kind == fx_plt32) ? R_386_PLT32 : R_386_32;
+			patch32(text, f.offset, r.addend); // i386 keeps the addend in the field
+		}
+		rels.push_back(r);
+	}
+
+	std::string shstrtab(1, '\0');
+	unsigned sh_name[num_sections] = { 0 };
+	sh_name[sec_text] = add_string(shstrtab, ".text");
+	sh_name[sec_rel] = add_string(shstrtab, x64 ? ".rela.text" : ".rel.text");
+	sh_name[sec_note] = add_string(shstrtab, ".note.GNU-stack");
+	sh_name[sec_symtab] = add_string(shstrtab, ".symtab");
+	sh_name[sec_strtab] = add_string(shstrtab, ".strtab");
+	sh_name[sec_shstrtab] = add_string(shstrtab, ".shstrtab");
+
+	//the file: the header (filled in last), the sections, the section headers
+	std::vector<unsigned char> f(x64 ? sizeof(Elf64_Ehdr) : sizeof(Elf32_Ehdr), 0);
+	unsigned long long offset[num_sections] = { 0 }, size[num_sections] = { 0 };
+
+	offset[sec_text] = f.size();
+	f.insert(f.end(), text.begin(), text.end());
+	size[sec_text] = text.size();
+
+	align(f, word);
+	offset[sec_rel] = f.size();
+	for( size_t k=0; k<rels.size(); k++ ) {
+		put(f, rels[k].offset, word);
+		if ( x64 ) {
+			put(f, ((unsigned long long)rels[k].sym << 32) | rels[k].type, 8);
+			put(f, rels[k].addend, 8);
+		} else {
+			put(f, (rels[k].sym << 8) | rels[k].type, 4);
+		}
+	}
+	size[sec_rel] = f.size() - offset[sec_rel];
+
+	offset[sec_note] = f.size();
+
+	offset[sec_symtab] = f.size();
+	for( size_t k=0; k<syms.size(); k++ ) {
+		put(f, syms[k].name, 4);
+		if ( x64 ) {
+			put(f, syms[k].info, 1);
+			put(f, 0, 1);
+			put(f, syms[k].shndx, 2);
+			put(f, syms[k].value, 8);
+			put(f, syms[k].size, 8);
+		} else {
+			put(f, syms[k].value, 4);
+			put(f, syms[k].size, 4);
+			put(f, syms[k].info, 1);
+			put(f, 0, 1);
+			put(f, syms[k].shndx, 2);
+		}
+	}
+	size[sec_symtab] = f.size() - offset[sec_symtab];
+
+	offset[sec_strtab] = f.size();
+	f.insert(f.end(), strtab.begin(), strtab.end());
+	size[sec_strtab] = strtab.size();
+
+	offset[sec_shstrtab] = f.size();
+	f.insert(f.end(), shstrtab.begin(), shstrtab.end());
+	size[sec_shstrtab] = shstrtab.size();
+
+	static const unsigned type[num_sections] =
+		{ SHT_NULL, SHT_PROGBITS, 0, SHT_PROGBITS, SHT_SYMTAB, SHT_STRTAB, SHT_STRTAB };
+	align(f, word);
+	unsigned long long sh_offset = f.size();
+	for( int k=0; k<num_sections; k++ ) {
+		unsigned long long flags = 0, entsize = 0, alignment = 1;
+		unsigned link = 0, info = 0, sh_type = type[k];
+		if ( k == sec_null ) alignment = 0;
+		if ( k == sec_text ) {
+			flags = SHF_ALLOC | SHF_EXECINSTR;
+			alignment = 16;
+		} else if ( k == sec_rel ) {
+			sh_type = x64 ? SHT_RELA : SHT_REL;
+			flags = SHF_INFO_LINK;
+			link = sec_symtab;
+			info = sec_text;
+			alignment = word;
+			entsize = x64 ? sizeof(Elf64_Rela) : sizeof(Elf32_Rel);
+		} else if ( k == sec_symtab ) {
+			link = sec_strtab;
+			info = first_global;
+			alignment = word;
+			entsize = x64 ? sizeof(Elf64_Sym) : sizeof(Elf32_Sym);
+		}
+		put(f, sh_name[k], 4);
+		put(f, sh_type, 4);
+		put(f, flags, word);
+		put(f, 0, word);
+		put(f, offset[k], word);
+		put(f, size[k], word);
+		put(f, link, 4);
+		put(f, info, 4);
+		put(f, alignment, word);
+		put(f, entsize, word);
+	}
+
+	std::vector<unsigned char> h;
+	put(h, ELFMAG0, 1); put(h, ELFMAG1, 1); put(h, ELFMAG2, 1); put(h, ELFMAG3, 1);
+	put(h, x64 ? ELFCLASS64 : ELFCLASS32, 1);
+	put(h, ELFDATA2LSB, 1);
+	put(h, EV_CURRENT, 1);
+	put(h, ELFOSABI_SYSV, 1);
+	put(h, 0, 8);
+	put(h, ET_REL, 2);
+	put(h, x64 ? EM_X86_64 : EM_386, 2);
+	put(h, EV_CURRENT, 4);
+	put(h, 0, word);          // entry
+	put(h, 0, word);          // program headers
+	put(h, sh_offset, word);
+	put(h, 0, 4);             // flags
+	put(h, x64 ? sizeof(Elf64_Ehdr) : sizeof(Elf32_Ehdr), 2);
+	put(h, 0, 2);
+	put(h, 0, 2);
+	put(h, x64 ? sizeof(Elf64_Shdr) : sizeof(Elf32_Shdr), 2);
+	put(h, num_sections, 2);
+	put(h, sec_shstrtab, 2);
+	std::copy(h.begin(), h.end(), f.begin());
+
+	out->append((const char*)&f[0], f.size());
+	return true;
+}
@@ -0,0 +1,101 @@
+#ifndef ASSEMBLER_HPP
+#define ASSEMBLER_HPP
+
+#include <map>
+#include <string>
+#include <vector>
+#include "peephole.hpp"
+#include "regalloc.hpp"
+
+// Turns the lines the code generators write (as AsmInst, after the
+// peephole optimizer) straight into x86 machine code, and writes that out
+// as a relocatable ELF object that links with start.c, so no text has to
+// go through gas.  It knows the instructions, operand forms and
+// directives Codegen, IrEmitter and Peephole produce, and nothing else;
+// anything it cannot encode is reported by error().
+//
+// Everything goes into one .text section.  Jumps and calls to labels of
+// this object are resolved when it is written; references to anything
+// else (printf, the .comm heap pointers) become relocations.
+class Assembler
+{
+  public:
+
+  //how a 32 bit field refers to a symbol
+  enum FixupKind
+  {
+    fx_pc32,   // relative to the end of the field (jumps, calls, %rip)
+    fx_plt32,  // the same, through the PLT (call printf@PLT)
+    fx_abs32   // the address itself
+  };
+
+  private:
+
+  struct Operand
+  {
+    enum Kind { reg, imm, mem, sym };
+
+    Kind kind;
+    int reg_num;        // reg: 0-15, mem: the base register or -1
+    int size;           // reg: 8, 32 or 64
+    bool rip;           // mem: relative to %rip
+    long long value;    // imm: the value, mem: the displacement
+    std::string symbol; // imm, mem, sym: the symbol added to value
+    bool plt;           // sym: name@PLT
+  };
+
+  struct Fixup
+  {
+    size_t offset;      // of the 32 bit field in .text
+    std::string symbol;
+    FixupKind kind;
+    long long addend;
+  };
+
+  struct Common
+  {
+    std::string name;
+    int size, align;
+  };
+
+  Target m_target;
+  std::vector<unsigned char> m_text;
+  std::map<std::string, size_t> m_labels;  // label -> offset in .text
+  std::vector<std::string> m_label_order;  // labels in the order defined
+  std::vector<std::string> m_globals;      // .global names, first mention first
+  std::map<std::string, bool> m_functions; // names given .type @function
+  std::vector<Common> m_common;
+  std::vector<Fixup> m_fixups;
+  std::string m_error;
+
+  void fail(const std::string & line, const char* what);
+  bool parse_operand(const std::string & s, Operand & o, bool target);
+  void directive(const std::string & text);
+
+  void byte(unsigned b) { m_text.push_back((unsigned char)b); }
+  void imm(long long v, int bytes);
+  void immediate(const Operand & o, int bytes);
+  void field(const std::string & symbol, FixupKind kind, long long addend);
+  void rex(bool w, int reg, const Operand & rm);
+  void opcode(unsigned op);
+  void modrm(int reg, const Operand & rm, int imm_bytes);
+  void encode_rm(bool w, unsigned op, int reg, const Operand & rm, int imm_bytes);
+
+  bool encode(const AsmInst & i);
+
+  public:
+
+  Assembler(Target target);
+
+  //assembles one line
+  void assemble(const AsmInst & i);
+
+  //the first problem found, empty if there was none
+  const std::string & error() { return m_error; }
+
+  //resolves the labels and appends the object to out; false if something
+  //did not assemble
+  bool write(OutputBuffer* out);
+};
+
+#endif //ASSEMBLER_HPP
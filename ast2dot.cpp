@@ -6,7 +6,7 @@
 
 #include <stack>
 
-class Ast2dot : public Visitor {
+class Ast2dot final : public Visitor, public StaticVisitor<Ast2dot> {
  private:
  FILE *m_out; //file for writting output
  int count; //used to give each node a uniq id
@@ -40,12 +40,13 @@ class Ast2dot : public Visitor {
 	fprintf( m_out, "\"%d\" [label=\"NULL\",fillcolor=red]\n" , c );
  }
 
- void draw( const char* n, Visitable* p) {
+ template <class Node>
+ void draw( const char* n, Node* p) {
 	count++; 			// each node gets a unique number
 	add_edge( s.top(), count ); 	// from parent to this 
 	add_node( count, n );		// name the this node
 	s.push(count);			// now this node is the parent
-	p->visit_children(this);	
+	visit_children(p);	
 	s.pop();			// now restore old parent
  }
 
@@ -113,7 +114,7 @@ class Ast2dot : public Visitor {
 
 void dopass_ast2dot(Program_ptr ast) {
         Ast2dot* ast2dot = new Ast2dot(stdout); //create the visitor
-        ast->accept(ast2dot); //walk the tree with the visitor above
+        ast2dot->dispatch(ast); //walk the tree with the visitor above
 	ast2dot->finish(); // finalize the printout
 	delete ast2dot;
 }
@@ -1,7 +1,11 @@
 #include <vector>
+#include <deque>
+#include <unordered_map>
 
 #ifndef ATTRIBUTE_HPP
 #define ATTRIBUTE_HPP
+#include "intern.hpp"
+#include "arena.hpp"
 class SymScope;
 
 enum Basetype
@@ -17,7 +21,7 @@ enum Basetype
 struct CompoundType
 {
 	Basetype baseType;
-	const char * classID;
+	SymId classID;
 };
 
 struct MethodType
@@ -30,25 +34,64 @@ struct AllType
 {
 	Basetype baseType;
 	CompoundType classType;
-	MethodType methodType;
-	
-	int m_offset;
-	int m_size;
+	MethodType* methodType; //only set for methods, see AttributeTable
+	// the symbols made by Typecheck live in the current arena, like the nodes
+	static void* operator new(size_t size) { return Arena::current()->allocate(size); }
+	static void operator delete(void*) {}
 };
 
-class Attribute
+// The value of an expression as constant propagation sees it: a constant
+// known at compile time, or TOP when it can only be found out by running
+// the program.
+struct LatticeElem
 {
+	bool is_const;
+	long long value; // (wide enough for a word of either target)
+};
+
+// The attributes computed by the passes are kept out of the AST nodes.
+// Every node carries a dense index (m_index, handed out in construction
+// order), and the type of the subtree rooted at a node lives at that
+// index in a compact array.  Method signatures are stored once per method
+// and the Symbol for the method points at the same signature.
+class AttributeTable
+{
+  std::vector<CompoundType> m_type;              // indexed by node index
+  std::vector<LatticeElem> m_lattice;            // indexed by node index
+  std::deque<MethodType> m_signatures;           // stable addresses
+  std::unordered_map<int, MethodType*> m_signature_of; // node index -> signature
+
   public:
-  AllType m_type; //type of the subtree
-  int lineno; //line number on which that ast node resides
-  SymScope * m_scope;
 
+  AttributeTable(int node_count) {
+	CompoundType undef;
+	undef.baseType = bt_undef;
+	undef.classID = sym_none;
+	m_type.assign(node_count, undef);
+	LatticeElem top;
+	top.is_const = false;
+	top.value = 0;
+	m_lattice.assign(node_count, top);
+  }
+
+  //the type of the subtree rooted at p
+  template <class Node>
+  CompoundType& type(Node* p) { return m_type[p->m_index]; }
 
-  Attribute() { 
-	m_type.baseType = bt_undef;
-	lineno = 0;
+  //the value constant propagation found for expression p (TOP unless
+  //that pass ran and proved it constant)
+  template <class Node>
+  LatticeElem& lattice(Node* p) { return m_lattice[p->m_index]; }
+
+  //the signature of method p (created empty the first time it is asked for)
+  template <class Node>
+  MethodType& signature(Node* p) {
+	std::unordered_map<int, MethodType*>::iterator i = m_signature_of.find(p->m_index);
+	if ( i != m_signature_of.end() ) return *i->second;
+	m_signatures.push_back(MethodType());
+	m_signature_of[p->m_index] = &m_signatures.back();
+	return m_signatures.back();
   }
 };
 
 #endif //ATTRIBUTE_HPP
-
@@ -0,0 +1,289 @@
+#include "cache.hpp"
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <thread>
+#include <vector>
+
+/****** Hash128 Implementation **************************************/
+
+static inline unsigned long long rotl(unsigned long long x, int r)
+{
+	return (x << r) | (x >> (64 - r));
+}
+
+static inline unsigned long long fmix(unsigned long long k)
+{
+	k ^= k >> 33;
+	k *= 0xff51afd7ed558ccdULL;
+	k ^= k >> 33;
+	k *= 0xc4ceb9fe1a85ec53ULL;
+	k ^= k >> 33;
+	return k;
+}
+
+static const unsigned long long c1 = 0x87c37b91114253d5ULL;
+static const unsigned long long c2 = 0x4cf5ad432745937fULL;
+
+static unsigned long long load64(const unsigned char* p)
+{
+	unsigned long long v = 0;
+	for( int k=7; k>=0; k-- ) v = (v << 8) | p[k];
+	return v;
+}
+
+Hash128::Hash128()
+{
+	m_h1 = m_h2 = 0;
+	m_tail_size = 0;
+	m_length = 0;
+}
+
+void Hash128::block(const unsigned char* b)
+{
+	unsigned long long k1 = load64(b), k2 = load64(b+8);
+
+	k1 *= c1; k1 = rotl(k1, 31); k1 *= c2; m_h1 ^= k1;
+	m_h1 = rotl(m_h1, 27); m_h1 += m_h2; m_h1 = m_h1*5 + 0x52dce729;
+
+	k2 *= c2; k2 = rotl(k2, 33); k2 *= c1; m_h2 ^= k2;
+	m_h2 = rotl(m_h2, 31); m_h2 += m_h1; m_h2 = m_h2*5 + 0x38495ab5;
+}
+
+void Hash128::add(const void* data, size_t n)
+{
+	const unsigned char* p = (const unsigned char*)data;
+	m_length += n;
+	if ( m_tail_size > 0 ) {
+		size_t take = std::min(n, 16 - m_tail_size);
+		memcpy(m_tail + m_tail_size, p, take);
+		m_tail_size += take;
+		p += take;
+		n -= take;
+		if ( m_tail_size < 16 ) return;
+		block(m_tail);
+		m_tail_size = 0;
+	}
+	for( ; n >= 16; p += 16, n -= 16 ) block(p);
+	memcpy(m_tail, p, n);
+	m_tail_size = n;
+}
+
+void Hash128::add(const char* s)
+{
+	add(s, strlen(s) + 1); // with the terminator, so "ab","c" != "a","bc"
+}
+
+std::string Hash128::hex()
+{
+	unsigned long long h1 = m_h1, h2 = m_h2, k1 = 0, k2 = 0;
+	for( size_t k = m_tail_size; k-- > 0; ) {
+		if ( k >= 8 ) k2 = (k2 << 8) | m_tail[k];
+		else k1 = (k1 << 8) | m_tail[k];
+	}
+	if ( m_tail_size > 8 ) { k2 *= c2; k2 = rotl(k2, 33); k2 *= c1; h2 ^= k2; }
+	if ( m_tail_size > 0 ) { k1 *= c1; k1 = rotl(k1, 31); k1 *= c2; h1 ^= k1; }
+
+	h1 ^= m_length; h2 ^= m_length;
+	h1 += h2; h2 += h1;
+	h1 = fmix(h1); h2 = fmix(h2);
+	h1 += h2; h2 += h1;
+
+	char buf[33];
+	snprintf(buf, sizeof(buf), "%016llx%016llx", h1, h2);
+	return buf;
+}
+
+/****** CompileCache Implementation **************************************/
+
+//the compiler that makes the outputs is part of every key, so a rebuilt
+//compiler does not pick up the entries of the old one
+static void add_compiler(Hash128 & h)
+{
+	struct stat st;
+	if ( stat("/proc/self/exe", &st) != 0 ) memset(&st, 0, sizeof(st));
+	long long id[3] = { (long long)st.st_size, (long long)st.st_mtim.tv_sec, (long long)st.st_mtim.tv_nsec };
+	h.add(id, sizeof(id));
+}
+
+static bool is_word(char c)
+{
+	return isalnum((unsigned char)c) || c == '_';
+}
+
+//the source as the scanner sees it: comments (which the scanner drops)
+//and whitespace are left out, except for a single space where taking it
+//out would join two tokens (two words, or < = and / * which would turn
+//into <= and a comment)
+static void add_source(Hash128 & h, const char* text, size_t size)
+{
+	char buf[4096];
+	size_t n = 0;
+	bool space = false;    // whitespace since the last character kept
+	char prev = 0;         // the last character kept
+	for( size_t i=0; i<size; ) {
+		char c = text[i];
+		if ( c == ' ' || c == '\t' || c == '\n' ) {
+			space = true;
+			i++;
+			continue;
+		}
+		if ( c == '/' && i+1 < size && text[i+1] == '*' ) {
+			const char* end = (const char*)memmem(text+i+2, size-i-2, "*/", 2);
+			i = end ? (end - text) + 2 : size;
+			space = true;
+			continue;
+		}
+		if ( n + 2 > sizeof(buf) ) {
+			h.add(buf, n);
+			n = 0;
+		}
+		if ( space && ((is_word(prev) && is_word(c)) || (prev == '<' && c == '=') || (prev == '/' && c == '*')) )
+			buf[n++] = ' ';
+		buf[n++] = c;
+		space = false;
+		prev = c;
+		i++;
+	}
+	h.add(buf, n);
+}
+
+Hash128 CompileCache::seed(const char* config)
+{
+	Hash128 h;
+	add_compiler(h);
+	h.add(config);
+	return h;
+}
+
+std::string CompileCache::key(const char* config, const char* text, size_t size)
+{
+	Hash128 h = seed(config);
+	add_source(h, text, size);
+	return h.hex();
+}
+
+CompileCache::CompileCache(const char* dir, unsigned long long limit)
+{
+	m_limit = limit;
+	m_size = 0;
+	m_hits = m_misses = m_stores = m_evictions = 0;
+	if ( mkdir(dir, 0777) != 0 && errno != EEXIST ) return;
+	DIR* d = opendir(dir);
+	if ( !d ) return;
+	m_dir = dir;
+
+	// what is already there counts against the limit
+	while ( struct dirent* e = readdir(d) ) {
+		struct stat st;
+		if ( !strchr(e->d_name, '.') && stat(path(e->d_name).c_str(), &st) == 0 ) m_size += st.st_size;
+	}
+	closedir(d);
+}
+
+std::string CompileCache::path(const std::string & key)
+{
+	return m_dir + "/" + key;
+}
+
+bool CompileCache::fetch(const std::string & key, OutputBuffer* out)
+{
+	std::string name = path(key);
+	FILE* f = fopen(name.c_str(), "rb");
+	if ( !f ) {
+		m_misses++;
+		return false;
+	}
+	char buf[64 * 1024];
+	size_t n;
+	while ( (n = fread(buf, 1, sizeof(buf), f)) > 0 ) out->append(buf, n);
+	bool ok = !ferror(f);
+	fclose(f);
+	if ( !ok ) {
+		m_misses++;
+		return false;
+	}
+	utimensat(AT_FDCWD, name.c_str(), NULL, 0); // now the most recently used
+	m_hits++;
+	return true;
+}
+
+void CompileCache::store(const std::string & key, OutputBuffer* out)
+{
+	// a name of its own for every writer, then one atomic rename
+	char suffix[64];
+	snprintf(suffix, sizeof(suffix), ".tmp%d.%zx", (int)getpid(), std::hash<std::thread::id>()(std::this_thread::get_id()));
+	std::string name = path(key), temp = name + suffix;
+	struct stat old;
+	bool replaced = (stat(name.c_str(), &old) == 0);
+	FILE* f = fopen(temp.c_str(), "wb");
+	if ( !f ) return;
+	bool ok = (out->size() == 0 || fwrite(out->data(), 1, out->size(), f) == out->size());
+	if ( fclose(f) != 0 ) ok = false;
+	if ( !ok || rename(temp.c_str(), name.c_str()) != 0 ) {
+		unlink(temp.c_str());
+		return;
+	}
+	m_stores++;
+	m_size += out->size();
+	if ( replaced ) m_size -= old.st_size; // another compilation got there first
+	if ( m_size > m_limit ) evict();
+}
+
+//removes the least recently used entries until the rest fit into three
+//quarters of the limit (so that not every store has to evict)
+void CompileCache::evict()
+{
+	std::lock_guard<std::mutex> hold(m_evict_lock);
+
+	struct Entry
+	{
+		std::string name;
+		time_t used;
+		long nsec;
+		unsigned long long size;
+		bool operator<(const Entry & o) const { return used != o.used ? used < o.used : nsec < o.nsec; }
+	};
+	std::vector<Entry> entries;
+	unsigned long long total = 0;
+	DIR* d = opendir(m_dir.c_str());
+	if ( !d ) return;
+	while ( struct dirent* e = readdir(d) ) {
+		struct stat st;
+		if ( strchr(e->d_name, '.') ) continue; // not ., .. or temporaries
+		std::string name = path(e->d_name);
+		if ( stat(name.c_str(), &st) != 0 ) continue;
+		Entry entry = { name, st.st_mtim.tv_sec, st.st_mtim.tv_nsec, (unsigned long long)st.st_size };
+		entries.push_back(entry);
+		total += entry.size;
+	}
+	closedir(d);
+
+	std::sort(entries.begin(), entries.end());
+	for( size_t k=0; k<entries.size() && total > m_limit / 4 * 3; k++ ) {
+		if ( unlink(entries[k].name.c_str()) != 0 ) continue;
+		total -= entries[k].size;
+		m_evictions++;
+	}
+	m_size = total;
+}
+
+void CompileCache::print_text(FILE* out)
+{
+	fprintf(out, "cache: %u hits, %u misses, %u stored, %u evicted, %llu of %llu bytes used\n",
+	        (unsigned)m_hits, (unsigned)m_misses, (unsigned)m_stores, (unsigned)m_evictions,
+	        (unsigned long long)m_size, m_limit);
+}
+
+void CompileCache::print_json(FILE* out)
+{
+	fprintf(out, "{\"cache\": {\"hits\": %u, \"misses\": %u, \"stored\": %u, \"evicted\": %u, \"bytes\": %llu, \"limit\": %llu}}\n",
+	        (unsigned)m_hits, (unsigned)m_misses, (unsigned)m_stores, (unsigned)m_evictions,
+	        (unsigned long long)m_size, m_limit);
+}
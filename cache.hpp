@@ -0,0 +1,79 @@
+#ifndef CACHE_HPP
+#define CACHE_HPP
+
+#include <stdio.h>
+#include <atomic>
+#include <mutex>
+#include <string>
+#include "output.hpp"
+
+// A 128 bit hash of a stream of bytes (MurmurHash3, the x64 128 bit
+// variant), fed in pieces of any size.
+class Hash128
+{
+  unsigned long long m_h1, m_h2;
+  unsigned char m_tail[16];  // bytes not yet making up a whole block
+  size_t m_tail_size;
+  size_t m_length;
+
+  void block(const unsigned char* b);
+
+  public:
+
+  Hash128();
+
+  void add(const void* data, size_t n);
+  void add(const char* s);
+
+  //the hash of everything added, as 32 hex digits
+  std::string hex();
+};
+
+// An on-disk cache of compiler outputs, for inputs that are compiled
+// over and over again.  An entry is a file in the cache directory named
+// after its key, holding the output (assembly or object) exactly as it
+// would be written.  The key is a hash of the compiler itself, the
+// options that shape the output, and the source with its comments and
+// the whitespace between tokens taken out; only compilations that
+// succeeded are stored, so the key does not need line numbers.
+//
+// Entries are written to a temporary file and renamed, so several
+// compilations (threads or processes) can share one directory.  A hit
+// touches its entry; when the entries add up to more than the size
+// limit, the least recently used ones are removed.
+class CompileCache
+{
+  std::string m_dir;
+  unsigned long long m_limit;         // bytes
+  std::atomic<unsigned long long> m_size; // bytes in the directory, as far as we know
+  std::mutex m_evict_lock;
+
+  std::atomic<unsigned> m_hits, m_misses, m_stores, m_evictions;
+
+  std::string path(const std::string & key);
+  void evict();
+
+  public:
+
+  //false from ready() if the directory cannot be made
+  CompileCache(const char* dir, unsigned long long limit);
+  bool ready() { return !m_dir.empty(); }
+
+  //the key for compiling text (size bytes) with the options described
+  //by config
+  static std::string key(const char* config, const char* text, size_t size);
+  //a hash that starts out like every key for config, for entries that
+  //are keyed on something other than a whole source
+  static Hash128 seed(const char* config);
+
+  //appends the entry for key to out; false if there is none
+  bool fetch(const std::string & key, OutputBuffer* out);
+  //stores the output of a compilation under key
+  void store(const std::string & key, OutputBuffer* out);
+
+  //the hits, misses and size so far, for -ftime-report
+  void print_text(FILE* out);
+  void print_json(FILE* out);
+};
+
+#endif //CACHE_HPP
@@ -1,27 +1,24 @@
 #include "classhierarchy.hpp"
+#include <assert.h>
 
 /****** ClassName Implemenation **************************************/
 
-ClassName::ClassName(char* const x)
+ClassName::ClassName(SymId x)
 {
-    m_spelling = x;
-    m_parent_attribute = NULL;
+    m_id = x;
 }
 ClassName::ClassName(const char* const x)
 {
-    m_spelling = strdup(x);
-    m_parent_attribute = NULL;
+    m_id = Interner::intern(x);
 }
 
 ClassName::ClassName(const ClassName & other)
 {
-    m_spelling = strdup(other.m_spelling);
-    m_parent_attribute = other.m_parent_attribute;
+    m_id = other.m_id;
 }
 
 ClassName& ClassName::operator=(const ClassName & other)
 {
-    delete m_spelling;
     ClassName tmp(other);
     swap(tmp);
     return *this;
@@ -29,12 +26,11 @@ ClassName& ClassName::operator=(const ClassName & other)
 
 void ClassName::swap(ClassName & other)
 {
-    std::swap(m_spelling, other.m_spelling);
+    std::swap(m_id, other.m_id);
 }
 
 ClassName::~ClassName()
 {
-    delete( m_spelling );
 }
 
 void ClassName::accept(Visitor *v)
@@ -47,94 +43,231 @@ ClassName* ClassName::clone() const
     return new ClassName(*this);
 }
 
+SymId ClassName::id()
+{
+    return m_id;
+}
+
 const char* ClassName::spelling()
 {
-    return m_spelling;
+    return Interner::spelling(m_id);
 }
 
 /****** ClassTable Implemenation **************************************/
 
 ClassTable::ClassTable() {
     topClass = new ClassNode();
-    topClass->name = new ClassName((char * const) "TopClass");
+    topClass->name = new ClassName("TopClass");
     topClass->superClass = NULL;
     topClass->p = NULL;
-    topClass->scope = NULL;
+    topClass->members = new MemberMap();
+    frozen = false;
 }
 
 ClassTable::~ClassTable() {
+    for(std::vector<ClassNode*>::iterator i = nodes.begin(); i != nodes.end(); i++){
+        delete (*i)->members;
+        delete (*i)->offset;
+        delete *i;
+    }
+    delete topClass->members;
+    delete topClass->offset;
     delete topClass;
 }
 
+bool ClassTable::exist( SymId name ) {
+    return (this->lookup(name) != NULL);
+}
+
+ClassNode* ClassTable::lookup( SymId name ) {
+    ClassMap::iterator i = nameMap.find(name);
+    return (i != nameMap.end()) ? i->second : NULL;
+}
+
 bool ClassTable::exist( ClassName* name ) {
-    if(name)
-        return (this->lookup(name) != NULL);
-    return false;
+    return (this->lookup(name) != NULL);
+}
+
+ClassNode* ClassTable::lookup( ClassName * name ) {
+    return name ? lookup(name->id()) : NULL;
+}
+
+bool ClassTable::exist( const char * name, size_t len ) {
+    return (this->lookup(name, len) != NULL);
+}
+
+ClassNode* ClassTable::lookup( const char * name, size_t len ) {
+    SymId id = Interner::find(name, len);
+    return (id != sym_none) ? lookup(id) : NULL;
+}
+
+bool ClassTable::exist( const char * name ) {
+    return exist(name, strlen(name));
+}
+
+ClassNode* ClassTable::lookup( const char * name ) {
+    return lookup(name, strlen(name));
+}
+
+ClassNode* ClassTable::getParentOf( ClassNode * node ) {
+    return node ? node->parent : NULL;
+}
+
+ClassNode* ClassTable::getParentOf( ClassName * name ) {
+    return getParentOf(lookup(name));
+}
+
+ClassNode* ClassTable::getParentOf( const char * name ) {
+    return getParentOf(lookup(name));
 }
 
 ClassNode* ClassTable::insert( ClassName* name, ClassNode * node ) {
-    nameMap[std::string(name->spelling())] = node;
+    frozen = false;
+    node->parent = node->superClass ? lookup(node->superClass) : topClass;
+    ClassNode*& slot = nameMap[name->id()];
+    if(slot != node) nodes.push_back(node);
+    slot = node;
     return node;
 }
 
-ClassNode* ClassTable::insert( ClassName * name, ClassName * superClass, ClassImpl * astNode, SymScope * classScope ) {
+ClassNode* ClassTable::insert( ClassName * name, ClassName * superClass, ClassImpl * astNode ) {
     ClassNode* newNode = new ClassNode();
     newNode->name = name;
     newNode->superClass = superClass;
     newNode->p = astNode;
-    newNode->scope = classScope;
-    nameMap[std::string(name->spelling())] = newNode;
-    return newNode;
+    return insert(name, newNode);
 }
 
-ClassNode* ClassTable::lookup( ClassName * name ) {
-    if(name && nameMap.find(std::string(name->spelling()))!=nameMap.end())
-        return nameMap[std::string(name->spelling())];
-    else
-        return NULL;
+ClassNode* ClassTable::insert( const char * name, ClassNode * node ) {
+    return this->insert(new ClassName(name), node);
 }
 
-ClassNode* ClassTable::getParentOf( ClassName * name ) {
-    ClassNode *node = this->lookup(name);
-    if(node)
-        if (node->superClass)
-            return lookup(node->superClass);
-        else
-            return topClass;
-    else
-        return NULL;
+ClassNode* ClassTable::insert( const char  * name, const char * superClass, ClassImpl * astNode ) {
+    return this->insert(new ClassName(name), superClass ? new ClassName(superClass) : NULL, astNode);
+}
+
+void ClassTable::freeze() {
+    // who the subclasses of each class are; the superclass is found by
+    // name again, as a class inserted later may have taken over the name.
+    // A class that cannot be reached from TopClass (its superclass is
+    // itself, after a duplicate name) is left out, with an empty interval
+    std::unordered_map<ClassNode*, std::vector<ClassNode*> > children;
+    for(ClassMap::iterator i = nameMap.begin(); i != nameMap.end(); i++){
+        ClassNode* node = i->second;
+        node->order = -1;
+        node->last = -2;
+        node->parent = node->superClass ? lookup(node->superClass) : topClass;
+        children[node->parent].push_back(node);
+    }
+
+    // a preorder walk with a stack of its own, as the hierarchy can be
+    // deeper than the call stack; a class is pushed again to be closed
+    // once all its subclasses are numbered
+    int next = 0;
+    std::vector<std::pair<ClassNode*, bool> > stack;
+    stack.push_back(std::make_pair(topClass, false));
+    while(!stack.empty()){
+        ClassNode* node = stack.back().first;
+        bool done = stack.back().second;
+        stack.pop_back();
+        if(done){
+            node->last = next - 1;
+            continue;
+        }
+        node->order = next++;
+        stack.push_back(std::make_pair(node, true));
+        std::vector<ClassNode*> & sub = children[node];
+        for(size_t k = 0; k < sub.size(); k++)
+            stack.push_back(std::make_pair(sub[k], false));
+    }
+
+    // the classes left out are on a cycle of superclasses (after duplicate
+    // names); cut them loose, so that walking up from any class ends
+    for(ClassMap::iterator i = nameMap.begin(); i != nameMap.end(); i++)
+        if(i->second->order < 0) i->second->parent = NULL;
+    frozen = true;
 }
-    bool  ClassTable::exist( const char * name ){
-	return this->exist(new ClassName(name));	
+
+bool ClassTable::isSubclassOf( ClassNode* sub, ClassNode* super ) {
+    assert(frozen);
+    if(!sub || !super) return false;
+    if(sub == super) return true;
+    return super->order <= sub->order && sub->order <= super->last;
 }
-    ClassNode*  ClassTable::insert( const char * name, ClassNode * node ){
-	return this->insert(new ClassName(name),node);
+
+bool ClassTable::isSubclassOf( SymId sub, SymId super ) {
+    if(sub == super) return true;
+    return isSubclassOf(lookup(sub), lookup(super));
 }
 
-    ClassNode*  ClassTable::insert( const char  * name, const char * superClass, ClassImpl * astNode, SymScope * classScope ){
-	return this->insert(new ClassName(name),new ClassName(superClass),astNode,classScope);
+void ClassTable::seal( ClassNode* node, SymTab* st ) {
+    int level = st->level();
+    ClassNode* parent = node->parent;
+    delete node->members;
+    node->members = new MemberMap();
+    node->fields = parent ? parent->fields : 0;
+
+    Declaration_list::iterator dec_i;
+    for(dec_i = node->p->m_declaration_list->begin(); dec_i != node->p->m_declaration_list->end(); dec_i++){
+        VariableID_list* vars = ((DeclarationImpl*)(*dec_i))->m_variableid_list;
+        for(VariableID_list::iterator var_i = vars->begin(); var_i != vars->end(); var_i++){
+            SymId name = ((VariableIDImpl*)(*var_i))->m_symname->id();
+            Member m = { node, st->lookup(name, level), node->fields++ };
+            (*node->members)[name] = m;
+        }
+    }
+
+    Method_list::iterator meth_i;
+    for(meth_i = node->p->m_method_list->begin(); meth_i != node->p->m_method_list->end(); meth_i++){
+        SymId name = ((MethodIDImpl*)((MethodImpl*)(*meth_i))->m_methodid)->m_symname->id();
+        Member m = { node, st->lookup(name, level), -1 };
+        (*node->members)[name] = m;
+    }
 }
-    ClassNode*  ClassTable::lookup( const char * name ){
-	return this->lookup(new ClassName(name));
+
+const Member* ClassTable::member( ClassNode* cls, SymId name ) {
+    if(!cls || !cls->members) return NULL;
+    // the superclasses are sealed before their subclasses
+    for(ClassNode* c = cls; c && c->members; c = c->parent){
+        MemberMap::iterator i = c->members->find(name);
+        if(i != c->members->end()) return &i->second;
+    }
+    return NULL;
 }
-   
-    ClassNode*  ClassTable::getParentOf( const char * name ){
-	return this->getParentOf(new ClassName(name));
+
+const Member* ClassTable::member( SymId cls, SymId name ) {
+    return member(lookup(cls), name);
 }
+
 /****** OffsetTable Implemenation **************************************/
-void OffsetTable::insert(const char * symname, int offset, int size, CompoundType type)
+void OffsetTable::insert(SymId symname, int offset, int size, CompoundType type)
+{
+	Entry e = { symname, offset, size, type };
+	std::unordered_map<SymId, int>::iterator i = m_index.find(symname);
+	if(i != m_index.end()){
+		m_entries[i->second] = e;
+		return;
+	}
+	m_index[symname] = (int)m_entries.size();
+	m_entries.push_back(e);
+}
+const OffsetTable::Entry* OffsetTable::find(SymId symname) const
 {
-	m_offset[std::string(symname)]=offset;
-	m_size[std::string(symname)]=size;
-	m_type[std::string(symname)]=type;
+	for(const OffsetTable* t = this; t; t = t->m_parent){
+		std::unordered_map<SymId, int>::const_iterator i = t->m_index.find(symname);
+		if(i != t->m_index.end()) return &t->m_entries[i->second];
+	}
+	return NULL;
 }
-int OffsetTable::get_offset(const char * symname)
+int OffsetTable::get_offset(SymId symname)
 {
-	return m_offset[std::string(symname)];
+	const Entry* e = find(symname);
+	return e ? e->offset : 0;
 }
-int OffsetTable::get_size(const char * symname) 
+int OffsetTable::get_size(SymId symname) 
 {
-	return m_size[std::string(symname)];
+	const Entry* e = find(symname);
+	return e ? e->size : 0;
 }
 void OffsetTable::setTotalSize(int size)
 {
@@ -152,29 +285,25 @@ void OffsetTable::setParamSize(int size)
 {
 	paramSize=size;
 }
-void OffsetTable::copyTo(OffsetTable*dest)
-{
-	if(dest)
-	{
-		dest->m_offset=m_offset;
-		dest->m_size=m_size;
-		dest->m_type=m_type;
-		dest->totalSize=totalSize;
-		dest->paramSize=paramSize;
-	}
-}
 
-CompoundType OffsetTable::get_type(const char * symname)
+CompoundType OffsetTable::get_type(SymId symname)
 {
-	return m_type[std::string(symname)];
+	const Entry* e = find(symname);
+	return e ? e->type : CompoundType();
 }
 OffsetTable::OffsetTable()
 {
+	m_parent=NULL;
 	totalSize=0;
 	paramSize=0;
 }
-bool OffsetTable::exist(const char * symname)
+OffsetTable::OffsetTable(const OffsetTable* parent)
+{
+	m_parent=parent;
+	totalSize=parent ? parent->totalSize : 0;
+	paramSize=0;
+}
+bool OffsetTable::exist(SymId symname)
 {
-	return (m_offset.find(std::string(symname)))!=m_offset.end();
+	return find(symname)!=NULL;
 }
-
@@ -4,94 +4,178 @@
 #include "ast.hpp"
 #include "attribute.hpp"
 #include "symtab.hpp"
+#include "intern.hpp"
 #include <unordered_map>
+#include <vector>
 #include <cstddef>
 #include <cstring>
 #include <string>
 
+// Where the names of a frame or an object are: a packed list of entries,
+// and an index from name to entry.  The layout of a class extends the
+// layout of its superclass, which it refers to instead of copying: it
+// has only the entries of the class itself, and a name it does not have
+// is looked up in the superclass's.  A layout that another one extends
+// must not change any more.
 class OffsetTable
 {
 
+public:
+
+    struct Entry
+    {
+        SymId id;
+        int offset;
+        int size;
+        CompoundType type;
+    };
+
 private:
 
+    const OffsetTable* m_parent;                // the layout this one extends
     int totalSize;
     int paramSize;
-    std::unordered_map<std::string,int > m_offset;
-    std::unordered_map<std::string,int > m_size;
-    std::unordered_map<std::string,CompoundType> m_type;
+    std::vector<Entry> m_entries;               // this layout's own
+    std::unordered_map<SymId, int> m_index;     // name -> its own entry
 	
 public:
 
     OffsetTable();
+    // a layout that starts with everything in parent, and its size
+    OffsetTable(const OffsetTable* parent);
 	
-    void insert(const char * symname, int offset, int size,CompoundType type);
-    int get_offset(const char * symname);
-    int get_size(const char * symname);
-    CompoundType get_type(const char * symname);
-    bool exist(const char * symname);
+    void insert(SymId symname, int offset, int size,CompoundType type);
+    // the entry of symname, NULL if there is none
+    const Entry* find(SymId symname) const;
+    int get_offset(SymId symname);
+    int get_size(SymId symname);
+    CompoundType get_type(SymId symname);
+    bool exist(SymId symname);
 	
     int getTotalSize();
     void setTotalSize(int);
     int getParamSize();
     void setParamSize(int);
-    void copyTo(OffsetTable*);
 };
 
 
 class ClassName {
-    char* m_spelling; // "name" of the class
+    SymId m_id; // interned "name" of the class
     
     public:
     
     ClassName(const ClassName &);
     ClassName &operator=(const ClassName &);
-    ClassName(char* const x);
+    ClassName(SymId x);
     ClassName(const char* const x);
     ~ClassName();
     virtual void accept(Visitor *v);
     virtual ClassName *clone() const;
+    // allocated in the current arena, like the generated nodes
+    static void* operator new(size_t size) { return Arena::current()->allocate(size); }
+    static void operator delete(void*) {}
     void swap(ClassName &);
     
+    SymId id();
     const char* spelling();
     
-    Attribute* m_parent_attribute;
 };
 
+class ClassNode;
+
+// A member of a class, as seen from a class that has it (by defining it or
+// by inheriting it): the class that defines it, its symbol there (for a
+// method, with the signature), and for a field the slot it takes in an
+// object.  The fields of a class are numbered from 0 after those of its
+// superclass, so a field has the same slot in every subclass; a method
+// has slot -1.
+struct Member
+{
+    ClassNode* owner;
+    Symbol* symbol;
+    int slot;
+};
+
+typedef std::unordered_map<SymId, Member> MemberMap;
+
 class ClassNode {
     public:    
     ClassName *name;
     ClassName *superClass;
+    ClassNode *parent;  // the node of superClass (TopClass's without one)
     
     ClassImpl *p;
-    SymScope* scope;    
-    OffsetTable*offset;
+    OffsetTable*offset; // the layout of an object, made once by Codegen (NULL before)
+
+    // the hierarchy numbered by ClassTable::freeze: this class's place in
+    // a preorder walk from TopClass, and the last place taken by one of
+    // its subclasses (-1 and -2 while it is not numbered)
+    int order;
+    int last;
 
-    ClassNode(){offset=new OffsetTable();}
+    // the members the class declares itself, made by ClassTable::seal
+    // (NULL before that), the inherited ones being in the tables of its
+    // superclasses; and how many fields an object of the class has
+    MemberMap* members;
+    int fields;
+
+    ClassNode(){offset=NULL; parent=NULL; order=-1; last=-2; members=NULL; fields=0;}
 };
 
-typedef std::unordered_map<const std::string, ClassNode*, std::hash<std::string> > ClassMap;
+typedef std::unordered_map<SymId, ClassNode*> ClassMap;
 
 class ClassTable {
     ClassMap nameMap;
+    std::vector<ClassNode*> nodes; // every node inserted (a name maps to its last)
     ClassNode * topClass;
+    bool frozen;  // numbered, and no class inserted since
     
     public:
     ClassTable();
     ~ClassTable();
 
+    // numbers the hierarchy once all the classes are in, so that the
+    // subclasses of a class are exactly the classes whose number is in
+    // its interval [order, last]; isSubclassOf (which counts a class as
+    // a subclass of itself) is then two compares
+    void freeze();
+    bool isSubclassOf( ClassNode* sub, ClassNode* super );
+    bool isSubclassOf( SymId sub, SymId super );
+
+    // makes the member table of a class once its scope is complete (and
+    // those of its superclasses are made): the members it declares, its
+    // fields numbered after those of its superclass.  The scope of the
+    // class is the current scope of st
+    void seal( ClassNode* node, SymTab* st );
+    // the member name of a sealed class, own or inherited (an own one
+    // hiding an inherited one of the same name); NULL if it has none
+    const Member* member( ClassNode* cls, SymId name );
+    const Member* member( SymId cls, SymId name );
+
+    // lookups never allocate and probe the table (at most) once: by
+    // interned id or name, or by spelling, which is only looked up in the
+    // interner (a spelling it has never seen cannot name a class)
+    bool exist( SymId name );
+    ClassNode* lookup( SymId name );
+    bool exist( ClassName* name );
+    ClassNode* lookup( ClassName * name );
+    bool exist( const char * name, size_t len );
+    ClassNode* lookup( const char * name, size_t len );
     bool exist( const char * name );
-    ClassNode* insert( const char * name, ClassNode * node );
-    ClassNode* insert( const char  * name, const char * superClass, ClassImpl * astNode, SymScope * classScope );
     ClassNode* lookup( const char * name );
-    
+
+    // the superclass of a class (TopClass for one without), as found at
+    // insert and again by freeze; NULL for TopClass, unknown classes and
+    // those freeze found on a cycle
+    ClassNode* getParentOf( ClassNode * node );
+    ClassNode* getParentOf( ClassName * name );
     ClassNode* getParentOf( const char * name );
-     
-    bool exist( ClassName* name );
+
+    // a superclass has to be inserted before its subclasses
     ClassNode* insert( ClassName * name, ClassNode * node );
-    ClassNode* insert( ClassName * name, ClassName * superClass, ClassImpl * astNode, SymScope * classScope );
-    ClassNode* lookup( ClassName * name );
-    
-    ClassNode* getParentOf( ClassName * name );
+    ClassNode* insert( ClassName * name, ClassName * superClass, ClassImpl * astNode );
+    ClassNode* insert( const char * name, ClassNode * node );
+    ClassNode* insert( const char  * name, const char * superClass, ClassImpl * astNode );
 };
 
 
@@ -0,0 +1,158 @@
+#include "classunits.hpp"
+#include "symtab.hpp"
+#include "primitive.hpp"
+#include "classhierarchy.hpp"
+#include <string.h>
+#include <algorithm>
+#include <vector>
+
+/****** UnitHasher **************************************/
+
+// Feeds the tree of one class into a hash, and collects the classes it
+// names (other than itself) in the order they first come up.  Every node
+// goes in as its kind, its children and an end mark, so two different
+// trees never give the same bytes.
+class UnitHasher final : public Visitor, public StaticVisitor<UnitHasher> {
+    private:
+    Hash128 & m_hash;
+    SymId m_self;
+    std::vector<SymId> & m_deps;
+
+    template <class Node>
+    void node(Node* p) {
+      unsigned char kind = (unsigned char)p->m_kind;
+      m_hash.add(&kind, 1);
+      visit_children(p);
+      m_hash.add("\xff", 1);
+    }
+
+    void name(const char* s) {
+      m_hash.add(s, strlen(s)+1);
+    }
+
+    public:
+
+    UnitHasher(Hash128 & hash, SymId self, std::vector<SymId> & deps)
+      : m_hash(hash), m_self(self), m_deps(deps) {}
+
+    void visitProgramImpl(ProgramImpl *p) { node(p); }
+    void visitClassImpl(ClassImpl *p) { node(p); }
+    void visitDeclarationImpl(DeclarationImpl *p) { node(p); }
+    void visitMethodImpl(MethodImpl *p) { node(p); }
+    void visitMethodBodyImpl(MethodBodyImpl *p) { node(p); }
+    void visitParameterImpl(ParameterImpl *p) { node(p); }
+    void visitAssignment(Assignment *p) { node(p); }
+    void visitIf(If *p) { node(p); }
+    void visitPrint(Print *p) { node(p); }
+    void visitReturnImpl(ReturnImpl *p) { node(p); }
+    void visitTInteger(TInteger *p) { node(p); }
+    void visitTBoolean(TBoolean *p) { node(p); }
+    void visitTNothing(TNothing *p) { node(p); }
+    void visitTObject(TObject *p) { node(p); }
+    void visitVariableIDImpl(VariableIDImpl *p) { node(p); }
+    void visitMethodIDImpl(MethodIDImpl *p) { node(p); }
+    void visitPlus(Plus *p) { node(p); }
+    void visitMinus(Minus *p) { node(p); }
+    void visitTimes(Times *p) { node(p); }
+    void visitDivide(Divide *p) { node(p); }
+    void visitAnd(And *p) { node(p); }
+    void visitLessThan(LessThan *p) { node(p); }
+    void visitLessThanEqualTo(LessThanEqualTo *p) { node(p); }
+    void visitNot(Not *p) { node(p); }
+    void visitUnaryMinus(UnaryMinus *p) { node(p); }
+    void visitMethodCall(MethodCall *p) { node(p); }
+    void visitSelfCall(SelfCall *p) { node(p); }
+    void visitVariable(Variable *p) { node(p); }
+    void visitIntegerLiteral(IntegerLiteral *p) { node(p); }
+    void visitBooleanLiteral(BooleanLiteral *p) { node(p); }
+    void visitNothing(Nothing *p) { node(p); }
+
+    // the class itself, its superclass, and the classes of its typed
+    // names all come through here
+    void visitClassIDImpl(ClassIDImpl *p) {
+      SymId cls = p->m_classname->id();
+      if ( cls != m_self && std::find(m_deps.begin(), m_deps.end(), cls) == m_deps.end() )
+        m_deps.push_back(cls);
+      node(p);
+    }
+
+    void visitSymName(SymName *p) { name(p->spelling()); }
+
+    void visitPrimitive(Primitive *p) { m_hash.add(&p->m_data, sizeof(p->m_data)); }
+
+    void visitClassName(ClassName *p) { name(p->spelling()); }
+
+    void visitNullPointer() { m_hash.add("\xfe", 1); }
+};
+
+/****** ClassUnits Implementation **************************************/
+
+ClassUnits::ClassUnits(ProgramImpl* program, CompileCache* cache, const char* config)
+{
+	m_cache = cache;
+	m_clean = 0;
+
+	Class_list::iterator class_i;
+	for( class_i = program->m_class_list->begin(); class_i != program->m_class_list->end(); class_i++ ) {
+		ClassImpl* c = (ClassImpl*)(*class_i);
+		SymId cls = ((ClassIDImpl*)c->m_classid_1)->m_classname->id();
+
+		Hash128 h = CompileCache::seed(config);
+		h.add("class");
+		std::vector<SymId> deps;
+		UnitHasher hasher(h, cls, deps);
+		hasher.dispatch(c);
+
+		// the keys of the classes it depends on are part of its own; those
+		// all come before it, or it is not cached
+		bool cached = (m_units.count(cls) == 0);
+		for( size_t k=0; k<deps.size() && cached; k++ ) {
+			std::map<SymId, Unit>::iterator d = m_units.find(deps[k]);
+			if ( d == m_units.end() || d->second.key.empty() ) cached = false;
+			else h.add(d->second.key.data(), d->second.key.size());
+		}
+
+		// a second class of the same name does not check; neither is cached
+		Unit & u = m_units[cls];
+		if ( !cached ) {
+			if ( u.text ) m_clean--;
+			delete u.text;
+			u.key.clear();
+			u.text = NULL;
+			continue;
+		}
+
+		u.key = h.hex();
+		u.text = new OutputBuffer(1 << 12);
+		if ( m_cache->fetch(u.key, u.text) ) {
+			m_clean++;
+		} else {
+			delete u.text;
+			u.text = NULL;
+		}
+	}
+}
+
+ClassUnits::~ClassUnits()
+{
+	std::map<SymId, Unit>::iterator i;
+	for( i = m_units.begin(); i != m_units.end(); i++ ) delete i->second.text;
+}
+
+bool ClassUnits::clean(SymId cls)
+{
+	std::map<SymId, Unit>::iterator i = m_units.find(cls);
+	return i != m_units.end() && i->second.text != NULL;
+}
+
+OutputBuffer* ClassUnits::text(SymId cls)
+{
+	return m_units[cls].text;
+}
+
+void ClassUnits::store(SymId cls, OutputBuffer* text)
+{
+	std::map<SymId, Unit>::iterator i = m_units.find(cls);
+	if ( i == m_units.end() || i->second.key.empty() ) return;
+	m_cache->store(i->second.key, text);
+}
@@ -0,0 +1,57 @@
+#ifndef CLASSUNITS_HPP
+#define CLASSUNITS_HPP
+
+#include <map>
+#include <string>
+#include "ast.hpp"
+#include "cache.hpp"
+#include "output.hpp"
+
+// The classes of a program as units of their own in the compile cache,
+// for -fincremental: a class whose unit is in the cache is neither
+// checked (beyond its fields and method signatures, which the other
+// classes need) nor folded nor generated again; its code is taken from
+// the cache instead.
+//
+// A unit is the code Codegen wrote for one class, as assembly text after
+// the peephole optimizer.  Its key is a hash of the class (its tree, with
+// names and literals but without line numbers) and of the keys of the
+// classes it depends on: its superclass, and every class it names as a
+// type.  Those are what the field layout and the calls of the class are
+// worked out from, so a change to a class also gives new keys to every
+// class that depends on it, directly or not, and nothing else.  A class
+// that names a class defined after it (which does not check anyway) is
+// not cached.
+class ClassUnits
+{
+  struct Unit
+  {
+    std::string key;      // empty if the class is not cached
+    OutputBuffer* text;   // the code from the cache, NULL if there was none
+
+    Unit() : text(NULL) {}
+  };
+
+  CompileCache* m_cache;
+  std::map<SymId, Unit> m_units;
+  int m_clean;
+
+  public:
+
+  //looks up every class of program in cache
+  ClassUnits(ProgramImpl* program, CompileCache* cache, const char* config);
+  ~ClassUnits();
+
+  //true if the code of the class came from the cache
+  bool clean(SymId cls);
+  //the code of a clean class
+  OutputBuffer* text(SymId cls);
+  //keeps the code generated for a class that was not clean
+  void store(SymId cls, OutputBuffer* text);
+
+  //how many classes there are, and how many of them were not clean
+  int classes() { return (int)m_units.size(); }
+  int compiled() { return (int)m_units.size() - m_clean; }
+};
+
+#endif //CLASSUNITS_HPP
@@ -2,6 +2,12 @@
 #include "symtab.hpp"
 #include "classhierarchy.hpp"
 #include "primitive.hpp"
+#include "ir.hpp"
+#include "regalloc.hpp"
+#include "peephole.hpp"
+#include "assembler.hpp"
+#include "trace.hpp"
+#include "classunits.hpp"
 #include "assert.h"
 #include <typeinfo>
 #include <stdio.h>
@@ -12,13 +18,35 @@
 #define forallr(riterator,listptr) \
   for(riterator = listptr->rbegin(); riterator != listptr->rend(); riterator++) \
 
-class Codegen : public Visitor
+// stack: every intermediate value is pushed on and popped off the stack
+// regalloc: each method is lowered to an IrFunction and its temporaries
+//           are given registers by LinearScan
+enum CodegenMode
+{
+  cg_stack,
+  cg_regalloc
+};
+
+class Codegen final : public Visitor, public StaticVisitor<Codegen>
 {
   private:
   
-  FILE * m_outputfile;
+  AsmBuffer m_asm;
   SymTab *m_symboltable;
   ClassTable *m_classtable;
+  AttributeTable *m_attributes;
+  CodegenMode m_mode;
+  Target m_target;
+  ClassUnits *m_units; // the classes whose code is in the cache, or NULL
+
+  // register mode: the method being lowered, and the virtual register
+  // holding the value of the expression visited last
+  IrFunction *m_ir;
+  VReg m_value;
+
+  // the type the checker computed for the subtree rooted at p
+  template <class Node>
+  CompoundType& type_of(Node* p) { return m_attributes->type(p); }
   
   const char * heapStart="_heap_start";
   const char * heapTop="_heap_top";
@@ -28,16 +56,28 @@ class Codegen : public Visitor
   OffsetTable*currClassOffset;
   OffsetTable*currMethodOffset;
 
-  char* currClassName;
+  SymId currClassName;
+
+  // interned names the generator needs to recognize
+  SymId program_id;
   
-  // basic size of a word (integers and booleans) in bytes
-  static const int wordsize = 4;
+  // basic size of a word (integers and booleans) in bytes: 4 on i386,
+  // 8 on x86-64
+  int wordsize;
+
+  // bytes right below the frame pointer the x86-64 prologue stores the
+  // register arguments of the current method in (0 on i386)
+  int home_size;
   
+  // labels are numbered per method and named after it (.LClass_method.0,
+  // .LClass_method.1, ...), so a change to one method does not renumber
+  // the labels of any other
   int label_count; //access with new_label
+  std::string m_label_prefix;
   
   // ********** Helper functions ********************************
   
-  // this is used to get new unique labels (cleverly named label1, label2, ...)
+  // this is used to get new unique labels within the current method
   int new_label() { return label_count++; }
 
   const char * bt_to_string(Basetype bt) {
@@ -147,154 +187,417 @@ class Codegen : public Visitor
   
   void init()
   {
-    fprintf( m_outputfile, ".text\n\n");
-    fprintf( m_outputfile, ".comm %s,4,4\n", heapStart);
-    fprintf( m_outputfile, ".comm %s,4,4\n\n", heapTop);
+    if (m_target == tg_x86_64) {
+      init_x86_64();
+      return;
+    }
+
+    m_asm.emit(".text\n\n");
+    m_asm.emit(".comm %s,4,4\n", heapStart);
+    m_asm.emit(".comm %s,4,4\n\n", heapTop);
     
-    fprintf( m_outputfile, "%s:\n", printFormat);
-    fprintf( m_outputfile, "       .string \"%%d\\n\"\n");
-    fprintf( m_outputfile, "       .text\n");
-    fprintf( m_outputfile, "       .globl  %s\n",printFun);
-    fprintf( m_outputfile, "       .type   %s, @function\n\n",printFun);
-    fprintf( m_outputfile, ".global %s\n",printFun);
-    fprintf( m_outputfile, "%s:\n",printFun);
-    fprintf( m_outputfile, "       pushl   %%ebp\n");
-    fprintf( m_outputfile, "       movl    %%esp, %%ebp\n");
-    fprintf( m_outputfile, "       movl    8(%%ebp), %%eax\n");
-    fprintf( m_outputfile, "       pushl   %%eax\n");
-    fprintf( m_outputfile, "       pushl   $.LC0\n");
-    fprintf( m_outputfile, "       call    printf\n");
-    fprintf( m_outputfile, "       addl    $8, %%esp\n");
-    fprintf( m_outputfile, "       leave\n");
-    fprintf( m_outputfile, "       ret\n\n");
+    m_asm.emit("%s:\n", printFormat);
+    m_asm.emit("       .string \"%%d\\n\"\n");
+    m_asm.emit("       .text\n");
+    m_asm.emit("       .globl  %s\n",printFun);
+    m_asm.emit("       .type   %s, @function\n\n",printFun);
+    m_asm.emit(".global %s\n",printFun);
+    m_asm.emit("%s:\n",printFun);
+    m_asm.emit("       pushl   %%ebp\n");
+    m_asm.emit("       movl    %%esp, %%ebp\n");
+    m_asm.emit("       movl    8(%%ebp), %%eax\n");
+    m_asm.emit("       pushl   %%eax\n");
+    m_asm.emit("       pushl   $.LC0\n");
+    m_asm.emit("       call    printf\n");
+    m_asm.emit("       addl    $8, %%esp\n");
+    m_asm.emit("       leave\n");
+    m_asm.emit("       ret\n\n");
   }
 
-  void start(int programSize)
+  // the same for x86-64: Print gets its argument in %rdi and passes it
+  // on to printf in %rsi (with %al = 0, no vector registers used)
+  void init_x86_64()
   {
-    fprintf( m_outputfile, "# Start Function\n");
-    fprintf( m_outputfile, ".global Start\n");
-    fprintf( m_outputfile, "Start:\n");
-    fprintf( m_outputfile, "        pushl   %%ebp\n");
-    fprintf( m_outputfile, "        movl    %%esp, %%ebp\n");
-    fprintf( m_outputfile, "        movl    8(%%ebp), %%ecx\n");
-    fprintf( m_outputfile, "        movl    %%ecx, %s\n",heapStart);
-    fprintf( m_outputfile, "        movl    %%ecx, %s\n",heapTop);
-    fprintf( m_outputfile, "        addl    $%d, %s\n",programSize,heapTop);
-    fprintf( m_outputfile, "        pushl   %s \n",heapStart);
-    fprintf( m_outputfile, "        call    Program_start \n");
-    fprintf( m_outputfile, "        leave\n");
-    fprintf( m_outputfile, "        ret\n");
+    m_asm.emit(".text\n\n");
+    m_asm.emit(".comm %s,8,8\n", heapStart);
+    m_asm.emit(".comm %s,8,8\n\n", heapTop);
+
+    m_asm.emit("%s:\n", printFormat);
+    m_asm.emit("       .string \"%%ld\\n\"\n");
+    m_asm.emit("       .text\n");
+    m_asm.emit("       .globl  %s\n",printFun);
+    m_asm.emit("       .type   %s, @function\n\n",printFun);
+    m_asm.emit("%s:\n",printFun);
+    m_asm.emit("       pushq   %%rbp\n");
+    m_asm.emit("       movq    %%rsp, %%rbp\n");
+    m_asm.emit("       movq    %%rdi, %%rsi\n");
+    m_asm.emit("       leaq    %s(%%rip), %%rdi\n", printFormat);
+    m_asm.emit("       movl    $0, %%eax\n");
+    m_asm.emit("       call    printf@PLT\n");
+    m_asm.emit("       leave\n");
+    m_asm.emit("       ret\n\n");
   }
 
-  void allocSpace(int size)
+  void start(int programSize)
   {
-    fprintf(m_outputfile, "        movl _heap_top, %%ecx\n");
-    fprintf(m_outputfile, "        addl $%d, %s\n", size, heapTop);
+    if (m_target == tg_x86_64) {
+      m_asm.emit("# Start Function\n");
+      m_asm.emit(".global Start\n");
+      m_asm.emit("Start:\n");
+      m_asm.emit("        pushq   %%rbp\n");
+      m_asm.emit("        movq    %%rsp, %%rbp\n");
+      m_asm.emit("        movq    %%rdi, %s(%%rip)\n",heapStart);
+      m_asm.emit("        movq    %%rdi, %s(%%rip)\n",heapTop);
+      m_asm.emit("        addq    $%d, %s(%%rip)\n",programSize,heapTop);
+      m_asm.emit("        call    Program_start\n");
+      m_asm.emit("        leave\n");
+      m_asm.emit("        ret\n");
+      return;
+    }
+
+    m_asm.emit("# Start Function\n");
+    m_asm.emit(".global Start\n");
+    m_asm.emit("Start:\n");
+    m_asm.emit("        pushl   %%ebp\n");
+    m_asm.emit("        movl    %%esp, %%ebp\n");
+    m_asm.emit("        movl    8(%%ebp), %%ecx\n");
+    m_asm.emit("        movl    %%ecx, %s\n",heapStart);
+    m_asm.emit("        movl    %%ecx, %s\n",heapTop);
+    m_asm.emit("        addl    $%d, %s\n",programSize,heapTop);
+    m_asm.emit("        pushl   %s \n",heapStart);
+    m_asm.emit("        call    Program_start \n");
+    m_asm.emit("        leave\n");
+    m_asm.emit("        ret\n");
   }
 
-////////////////////////////////////////////////////////////////////////////////
-public:
-  
-  Codegen(FILE * outputfile, SymTab * st, ClassTable* ct)
+  // register mode: lower an expression, returning its virtual register
+  VReg lower(Expression *e)
   {
-    m_outputfile = outputfile;
-    m_symboltable = st;
-    m_classtable = ct;
-    label_count = 0;
-    currMethodOffset=currClassOffset=NULL;
+    dispatch(e);
+    return m_value;
   }
 
-  void visitProgramImpl(ProgramImpl *p) {
+  void lower_binary(IrOp op, Expression *l, Expression *r)
+  {
+    VReg a = lower(l);
+    VReg b = lower(r);
+    m_value = m_ir->def(op, a, b);
+  }
 
-  	init();
-    fprintf(m_outputfile, "# PROGRAM\n");
+  // the layout of an object of class cls: its own fields, in the slots
+  // the class table gave them, after the layout of its superclass, which
+  // is made first if it is not there yet.  Each layout is made once, and
+  // kept in the class table for the classes that use it
+  OffsetTable* layout(ClassNode *cls)
+  {
+    // the superclasses that have no layout yet, nearest first
+    std::vector<ClassNode*> chain;
+    for(ClassNode* c = cls; c && !c->offset; c = m_classtable->getParentOf(c))
+      chain.push_back(c);
+
+    while(!chain.empty()){
+      ClassNode* c = chain.back();
+      chain.pop_back();
+      ClassNode* parent = m_classtable->getParentOf(c);
+      c->offset = new OffsetTable(parent ? parent->offset : NULL);
+      if(!c->p) continue;
+
+      Declaration_list::iterator dec_i;
+      forall(dec_i, c->p->m_declaration_list){
+        VariableID_list::iterator var_i;
+        forall(var_i, ((DeclarationImpl*)(*dec_i))->m_variableid_list){
+          SymId name = ((VariableIDImpl*)(*var_i))->m_symname->id();
+          const Member* m = m_classtable->member(c, name);
+          int offset = (m->slot + 1)*wordsize;
+
+          TRACE(tr_layout, 1, "## Class var: \'" << Interner::spelling(name) << "\', type: " << bt_to_string(m->symbol->baseType)
+                << ", offset: " << offset);
 
-    p->visit_children(this);
+          CompoundType type;
+          type.baseType = m->symbol->baseType;
+          type.classID = m->symbol->classType.classID;
+          c->offset->insert(name, offset, wordsize, type);
+        }
+      }
+      c->offset->setTotalSize(c->fields*wordsize);
+      TRACE(tr_layout, 1, "# CLASS SIZE: " << c->fields*wordsize);
+    }
+    return cls->offset;
+  }
 
+  // makes the layout of the class being generated the current one; the
+  // size of its fields
+  int layout_class(ClassImpl *p)
+  {
+    ClassNode* cls = m_classtable->lookup(((ClassIDImpl*)p->m_classid_1)->m_classname->id());
+    currClassOffset = layout(cls);
+    return currClassOffset->getTotalSize();
   }
-  void visitClassImpl(ClassImpl *p) {
-    fprintf(m_outputfile, "## CLASS\n");
 
-    ClassIDImpl* cid = ((ClassIDImpl*)p->m_classid_1);
-    char* className = strdup(cid->m_classname->spelling());
-    currClassName = strdup(className);
+  // the class that defines a method of class cls: cls itself, or the
+  // superclass it inherits the method from
+  SymId defining_class(SymId cls, SymId methodName)
+  {
+    const Member* m = m_classtable->member(cls, methodName);
+    return m ? m->owner->name->id() : cls;
+  }
 
-    CompoundType type;
-    type.classID = strdup(className);
-    type.baseType = bt_function;
+  // finds the object a method is invoked on (its frame offset and static
+  // type) and the class up its superclass chain that defines the method
+  void resolve_call(SymId variableName, SymId methodName, int & offset, CompoundType & type)
+  {
+    const OffsetTable::Entry* e = currMethodOffset->find(variableName);
+    if(!e) e = currClassOffset->find(variableName);
+    if(e){
+      type = e->type;
+      offset = e->offset;
+    }
 
-    currClassOffset = new OffsetTable();
+    type.classID = defining_class(type.classID, methodName);
+  }
 
-    int offset = 4;
-    int size = 0;
+  // an expression constant propagation worked out is not evaluated, its
+  // value is pushed (or put in a virtual register) directly
+  bool emit_folded(Expression *p)
+  {
+    LatticeElem & le = m_attributes->lattice(p);
+    if (!le.is_const) return false;
+    if (m_ir) m_value = m_ir->def(ir_const, no_vreg, no_vreg, le.value);
+    else m_asm.emit("        pushl $%lld\n", le.value);
+    return true;
+  }
 
-    ClassNode* current_class = m_classtable->lookup(className);
-    current_class = m_classtable->getParentOf(current_class->name);
-    while( strcmp(current_class->name->spelling(), "TopClass") != 0 && current_class->scope != NULL){
-      list<Declaration_ptr>::iterator dec_i;
-      forall(dec_i, current_class->p->m_declaration_list){
-        DeclarationImpl* d = (DeclarationImpl*)(*dec_i);
+  void emit_label(int label)
+  {
+    if (m_ir) m_ir->use(ir_label, no_vreg, no_vreg, label);
+    else m_asm.emit("%s%d:\n", m_label_prefix.c_str(), label);
+  }
 
-        d->m_type->accept(this);
-        Basetype decl_type = d->m_type->m_attribute.m_type.baseType;
+  // evaluates l and r, compares them and takes jcc (op in register mode)
+  // to the label
+  void compare_and_branch(Expression *l, Expression *r, const char *jcc, IrOp op, int label)
+  {
+    if (m_ir) {
+      VReg a = lower(l);
+      VReg b = lower(r);
+      m_ir->use(op, a, b, label);
+      return;
+    }
 
-        list<VariableID_ptr>::iterator var_i;
-        forall(var_i, d->m_variableid_list){
-          VariableIDImpl* var = ((VariableIDImpl*)(*var_i));
-          char *variableName = strdup(var->m_symname->spelling());
+    dispatch(l);
+    dispatch(r);
+    m_asm.emit("        popl %%ebx\n");
+    m_asm.emit("        popl %%eax\n");
+    m_asm.emit("        cmpl %%ebx, %%eax\n");
+    m_asm.emit("        %s %s%d\n", jcc, m_label_prefix.c_str(), label);
+  }
 
-          cerr << "## Class var: \'" << variableName << "\', type: " << bt_to_string(decl_type);
+  // jumps to the label when the predicate e is `when', falls through
+  // otherwise.  A relational predicate is a single compare and a
+  // conditional jump instead of a 0/1 that is then tested again; Not only
+  // flips the sense of the jump, and And branches on each side in turn
+  // (so its right side is skipped as soon as the left one is false).
+  void branch(Expression *e, bool when, int label)
+  {
+    LatticeElem & le = m_attributes->lattice(e);
+    if (le.is_const) {
+      if ((le.value != 0) == when) {
+        if (m_ir) m_ir->use(ir_jump, no_vreg, no_vreg, label);
+        else m_asm.emit("        jmp %s%d\n", m_label_prefix.c_str(), label);
+      }
+      return;
+    }
 
-          CompoundType type;
-          type.baseType = decl_type;
-          cerr << ", offset: " << offset << endl;
-          currClassOffset->insert(variableName, offset, wordsize, type);
-          
-          size = (size + wordsize);
-          offset = (offset + wordsize);
+    switch (e->m_kind) {
+      case nk_LessThan: {
+        LessThan *lt = (LessThan*)e;
+        compare_and_branch(lt->m_expression_1, lt->m_expression_2,
+                           when ? "jl" : "jge", when ? ir_branch_lt : ir_branch_ge, label);
+        return;
+      }
+      case nk_LessThanEqualTo: {
+        LessThanEqualTo *lte = (LessThanEqualTo*)e;
+        compare_and_branch(lte->m_expression_1, lte->m_expression_2,
+                           when ? "jle" : "jg", when ? ir_branch_le : ir_branch_gt, label);
+        return;
+      }
+      case nk_Not:
+        branch(((Not*)e)->m_expression, !when, label);
+        return;
+      case nk_And: {
+        And *a = (And*)e;
+        if (!when) {
+          branch(a->m_expression_1, false, label);
+          branch(a->m_expression_2, false, label);
+        } else {
+          int skip = new_label();
+          branch(a->m_expression_1, false, skip);
+          branch(a->m_expression_2, true, label);
+          emit_label(skip);
         }
+        return;
       }
-      current_class = m_classtable->getParentOf(current_class->name);
+      default:
+        break;
     }
 
-    list<Declaration_ptr>::iterator dec_i;
-    forall(dec_i, p->m_declaration_list){
-      DeclarationImpl* d = (DeclarationImpl*)(*dec_i);
+    // anything else is evaluated to its 0/1 value and tested
+    if (m_ir) {
+      m_ir->use(when ? ir_branch_true : ir_branch_false, lower(e), no_vreg, label);
+      return;
+    }
+    dispatch(e);
+    m_asm.emit("        popl %%eax\n");
+    m_asm.emit("        testl %%eax, %%eax\n");
+    m_asm.emit("        %s %s%d\n", when ? "jne" : "je", m_label_prefix.c_str(), label);
+  }
 
-      d->m_type->accept(this);
-      Basetype decl_type = d->m_type->m_attribute.m_type.baseType;
+  // materializes a comparison of the two values on the stack as 0/1
+  void emit_setcc(const char *set)
+  {
+    m_asm.emit("        popl %%ebx\n");
+    m_asm.emit("        popl %%eax\n");
+    m_asm.emit("        cmpl %%ebx, %%eax\n");
+    m_asm.emit("        %s %%al\n", set);
+    m_asm.emit("        movzbl %%al, %%eax\n");
+    m_asm.emit("        pushl %%eax\n");
+  }
 
-      list<VariableID_ptr>::iterator var_i;
-      forall(var_i, d->m_variableid_list){
-        VariableIDImpl* var = ((VariableIDImpl*)(*var_i));
-        char *variableName = strdup(var->m_symname->spelling());
+  // Where the object and the arguments of a method are in its frame.  On
+  // i386 the caller pushed them: the object is at 8(%ebp) and argument k
+  // at 12+4k(%ebp).  On x86-64 the object and the first five arguments
+  // arrive in registers, which the prologue stores right below %rbp (the
+  // object at -8(%rbp), argument k at -16-8k(%rbp)); any further ones
+  // were pushed by the caller above the return address.  The locals come
+  // below all that.
+  int this_offset()
+  {
+    return (m_target == tg_x86_64) ? -wordsize : 2*wordsize;
+  }
 
-        cerr << "## Class var: \'" << variableName << "\', type: " << bt_to_string(decl_type);
+  int param_offset(int k)
+  {
+    if (m_target == tg_i386) return wordsize*(3+k);
+    if (k+1 < sysv_reg_args) return -wordsize*(k+2);
+    return wordsize*(2 + k+1-sysv_reg_args);
+  }
 
-        CompoundType type;
-        type.baseType = decl_type;
-        cerr << ", offset: " << offset << endl;
-        currClassOffset->insert(variableName, offset, wordsize, type);
-        
-        size = (size + wordsize);
-        offset = (offset + wordsize);
-      }
+  // the number of words that arrive in registers for a method with
+  // num_args arguments
+  int reg_args(int num_args)
+  {
+    if (m_target == tg_i386) return 0;
+    return (num_args+1 < sysv_reg_args) ? num_args+1 : sysv_reg_args;
+  }
+
+  // register mode: evaluates the arguments of a call, last to first
+  void lower_arguments(Expression_list *args, std::vector<VReg> & values)
+  {
+    Expression_list::reverse_iterator exp_i;
+    forallr(exp_i, args){
+      values.push_back(lower(*exp_i));
     }
-    if (strcmp(type.classID, "Program") == 0) start(size);
+  }
 
-    // Set the size
-    cerr << "# CLASS SIZE: " << size << endl;
-    currClassOffset->setTotalSize(size);
-    p->m_attribute.m_type.m_size = size;
+  // register mode: passes the evaluated arguments and the object and
+  // makes the call.  Nothing is computed between the ir_args and the
+  // ir_call, so that on x86-64 they can all go into the argument registers
+  // at the call.
+  void lower_call(std::vector<VReg> & values, VReg object, SymId cls, SymId meth)
+  {
+    for (size_t k = 0; k < values.size(); k++) {
+      m_ir->use(ir_arg, values[k]);
+    }
+    m_ir->use(ir_arg, object);
+    m_value = m_ir->call(cls, meth, (values.size()+1)*wordsize);
+  }
+
+  void allocSpace(int size)
+  {
+    m_asm.emit("        movl _heap_top, %%ecx\n");
+    m_asm.emit("        addl $%d, %s\n", size, heapTop);
+  }
 
-    // Store class info for others to reference
-    ClassNode* currentClass = m_classtable->lookup(p->m_attribute.m_type.classType.classID);
-    currClassOffset->copyTo(currentClass->offset);
-    currClassOffset->setTotalSize(size);
+////////////////////////////////////////////////////////////////////////////////
+public:
+  
+  // the peephole optimizer runs from optimization level 1 up (its rules
+  // know the i386 instructions and registers only); the x86-64 target is
+  // only written by the register allocating generator.  With an object
+  // the code is assembled into it rather than written to output.  With
+  // units, the classes are generated as units of the compile cache (see
+  // classunits.hpp).
+  Codegen(OutputBuffer * output, SymTab * st, ClassTable* ct, AttributeTable* at, CodegenMode mode, Target target, int opt_level, Assembler* object, ClassUnits* units = NULL)
+    : m_asm(output, opt_level >= 1 && target == tg_i386, object)
+  {
+    assert(target == tg_i386 || mode == cg_regalloc);
+    m_attributes = at;
+    m_units = units;
+    m_mode = mode;
+    m_target = target;
+    wordsize = (target == tg_x86_64) ? 8 : 4;
+    home_size = 0;
+    m_ir = NULL;
+    m_value = no_vreg;
+    m_symboltable = st;
+    m_classtable = ct;
+    label_count = 0;
+    currMethodOffset=currClassOffset=NULL;
+    program_id = Interner::intern("Program");
+  }
 
-    list<Method_ptr>::iterator meth_i;
+  ~Codegen() {
+    delete currMethodOffset;
+  }
+
+  void visitProgramImpl(ProgramImpl *p) {
+
+  	init();
+    m_asm.emit("# PROGRAM\n");
+    m_asm.flush();
+
+    visit_children(p);
+
+    // the stack need not be executable (the object the assembler writes
+    // says so on its own)
+    m_asm.emit("\n.section .note.GNU-stack,\"\",@progbits\n");
+    m_asm.flush();
+  }
+  void visitClassImpl(ClassImpl *p) {
+    ClassIDImpl* cid = ((ClassIDImpl*)p->m_classid_1);
+    SymId className = cid->m_classname->id();
+    currClassName = className;
+
+    // with -fincremental a class that is in the cache is only laid out
+    // (the classes after it need that) and its code taken as it is; the
+    // code of every other class goes to the cache as well as the output
+    if (m_units && m_units->clean(className)) {
+      layout_class(p);
+      OutputBuffer* text = m_units->text(className);
+      m_asm.replay(text->data(), text->size());
+      return;
+    }
+    OutputBuffer unit(1 << 12);
+    if (m_units) m_asm.capture(&unit);
+
+    m_asm.emit("## CLASS\n");
+
+    int size = layout_class(p);
+    if (className == program_id) start(size);
+
+    Method_list::iterator meth_i;
     forall(meth_i, p->m_method_list){
-      (*meth_i)->accept(this);
+      dispatch(*meth_i);
+    }
+
+    // the code of a class never goes through the peephole optimizer
+    // together with that of another, so it comes out the same whether it
+    // is generated or taken from the cache
+    m_asm.flush();
+    if (m_units) {
+      m_asm.release();
+      m_units->store(className, &unit);
+      m_asm.replay(unit.data(), unit.size());
     }
   }
   void visitDeclarationImpl(DeclarationImpl *p) {
@@ -304,425 +607,559 @@ public:
   void visitMethodImpl(MethodImpl *p) {
     MethodIDImpl* m = ((MethodIDImpl*)p->m_methodid);
     visitMethodIDImpl(m);
-    char* methodName = strdup(m->m_symname->spelling());
+    SymId methodName = m->m_symname->id();
 
     MethodBody* mb = ((MethodBodyImpl*)p->m_methodbody);
     MethodBodyImpl* mbi = ((MethodBodyImpl*)mb);
     int num_args = p->m_parameter_list->size();
-    int num_locals = mbi->m_declaration_list->size();
-    int totalSize = num_locals*4;
+    int num_locals = 0;
+    Declaration_list::iterator dec_i;
+    forall(dec_i, mbi->m_declaration_list){
+      num_locals += ((DeclarationImpl*)(*dec_i))->m_variableid_list->size();
+    }
+    home_size = reg_args(num_args)*wordsize;
+    int totalSize = home_size + num_locals*wordsize;
+
+    label_count = 0;
+    m_label_prefix = std::string(".L") + Interner::spelling(currClassName) + "_" + Interner::spelling(methodName) + ".";
 
+    delete currMethodOffset;
     currMethodOffset = new OffsetTable();
     // currMethodOffset->insert(methodName, offset, size, type);
     currMethodOffset->setTotalSize(totalSize);
     currMethodOffset->setParamSize(num_args*wordsize);
 
-    int offset = wordsize*3;
-    list<Parameter_ptr>::iterator par_i;
+    int k = 0;
+    Parameter_list::iterator par_i;
     forall(par_i, p->m_parameter_list){
+      int offset = param_offset(k++);
       ParameterImpl* pa = (ParameterImpl*)(*par_i);
-      char* paramName = strdup(((VariableIDImpl*)(pa->m_variableid))->m_symname->spelling());
+      SymId paramName = ((VariableIDImpl*)(pa->m_variableid))->m_symname->id();
 
-      pa->m_type->accept(this);
-      Basetype param_type = pa->m_type->m_attribute.m_type.baseType;
+      dispatch(pa->m_type);
+      Basetype param_type = type_of(pa->m_type).baseType;
       
       CompoundType type;
       type.baseType = param_type;
       if(type.baseType == bt_object){
         TObject* t = (TObject*)pa->m_type;
         ClassIDImpl* cid = (ClassIDImpl*)t->m_classid;
-        type.classID = strdup(cid->m_classname->spelling());
+        type.classID = cid->m_classname->id();
       }
 
-      cerr << "## Param: \'" << paramName << "\', type: " << bt_to_string(param_type) << ", offset: " << offset << endl;
+      TRACE(tr_layout, 1, "## Param: \'" << Interner::spelling(paramName) << "\', type: " << bt_to_string(param_type) << ", offset: " << offset);
       currMethodOffset->insert(paramName, offset, wordsize, type);
-      offset = offset + wordsize;
     }
 
-    fprintf(m_outputfile, "### METHOD\n");
+    m_asm.emit("### METHOD\n");
 
-    fprintf(m_outputfile, "%s_%s:\n", currClassName, methodName);
+    if (m_mode == cg_regalloc) {
+      IrFunction ir;
+      m_ir = &ir;
+      visit_children(p);
+      m_ir = NULL;
+
+      LinearScan ra(&ir, m_target);
+      ra.run();
+      IrEmitter emitter(&m_asm, &ir, &ra, m_target, currMethodOffset->getTotalSize(), reg_args(num_args));
+      emitter.emit_method(Interner::spelling(currClassName), Interner::spelling(methodName));
+      m_asm.flush();
+      return;
+    }
+
+    m_asm.emit("%s_%s:\n", Interner::spelling(currClassName), Interner::spelling(methodName));
     // PROLOGUE
-    cerr << "## prologue" << endl;
+    TRACE(tr_frame, 1, "## prologue");
     // save the activation record pointer of the caller function
-    fprintf(m_outputfile, "        pushl %%ebp\n");
+    m_asm.emit("        pushl %%ebp\n");
     // setup activation record pointer
-    fprintf(m_outputfile, "        movl %%esp, %%ebp\n");
+    m_asm.emit("        movl %%esp, %%ebp\n");
 
     // allocate space for local variables
     // Subtract from stack pointer
-    fprintf(m_outputfile,"        subl $%d,%%esp\n", currMethodOffset->getTotalSize());
+    m_asm.emit("        subl $%d,%%esp\n", currMethodOffset->getTotalSize());
+    // %ebx is scratch here but callee save for the caller (and for the
+    // peephole optimizer, which keeps values in it across calls)
+    m_asm.emit("        pushl %%ebx\n");
 
-    p->visit_children(this);
+    visit_children(p);
+
+    // the method is complete, hand it to the peephole optimizer (and the
+    // assembler)
+    m_asm.flush();
   }
   void visitMethodBodyImpl(MethodBodyImpl *p) {
-    fprintf(m_outputfile, "#### METHODBODY\n");
+    if (!m_ir) m_asm.emit("#### METHODBODY\n");
 
-    int offset = (-wordsize);
-    list<Declaration_ptr>::iterator dec_i;
+    int offset = -home_size - wordsize;
+    Declaration_list::iterator dec_i;
     forall(dec_i, p->m_declaration_list){
       DeclarationImpl* d = (DeclarationImpl*)(*dec_i);
 
-      d->m_type->accept(this);
-      Basetype decl_type = d->m_type->m_attribute.m_type.baseType;
+      dispatch(d->m_type);
+      Basetype decl_type = type_of(d->m_type).baseType;
 
-      list<VariableID_ptr>::iterator var_i;
+      VariableID_list::iterator var_i;
       forall(var_i, d->m_variableid_list){
         VariableIDImpl* var = ((VariableIDImpl*)(*var_i));
-        char *variableName = strdup(var->m_symname->spelling());
+        SymId variableName = var->m_symname->id();
 
         CompoundType type;
         type.baseType = decl_type;
         if(type.baseType == bt_object){
           TObject* t = (TObject*)d->m_type;
           ClassIDImpl* cid = (ClassIDImpl*)t->m_classid;
-          type.classID = strdup(cid->m_classname->spelling());
-          // int objectSize = cid->m_attribute.m_type.m_size;
+          type.classID = cid->m_classname->id();
           ClassNode* classObj = m_classtable->lookup(type.classID);
 
           // int offset = classObj->offset->get_offset(variableName);
-          int size = classObj->offset->getTotalSize();
+          int size = layout(classObj)->getTotalSize();
           // CompoundType type = classObj->offset->get_type(variableName);
-          cerr << "## Local: \'" << variableName << "\', size: " << size 
-              << ", offset: " << offset
-              << ", classID: " << cid->m_classname->spelling() << endl;
+          TRACE(tr_layout, 1, "## Local: \'" << Interner::spelling(variableName) << "\', size: " << size
+                << ", offset: " << offset
+                << ", classID: " << cid->m_classname->spelling());
 
-          allocSpace(size);
+          if (m_ir) {
+            VReg object = m_ir->def(ir_alloc, no_vreg, no_vreg, size);
+            m_ir->use(ir_store_local, object, no_vreg, offset);
+          } else {
+            allocSpace(size);
 
-          fprintf(m_outputfile, "        movl %%ecx, %d(%%ebp)\n", offset);
+            m_asm.emit("        movl %%ecx, %d(%%ebp)\n", offset);
+          }
 
           // TODO: (same thing can be done inside self & methodcall for thier params)
           // find the location of this Variable # on stack (offset from ebp?) and set it equal to the location
           // of heapstart that is return from allocSpace
-          // fprintf(m_outputfile, "        pushl %d(%%ecx)\n", offset);
+          // m_asm.emit("        pushl %d(%%ecx)\n", offset);
           currMethodOffset->insert(variableName, offset, size, type);
         } else {
-          cerr << "## Local: \'" << variableName << "\', type: " << bt_to_string(decl_type) << endl; //", classID: " << type.classID << endl;
+          TRACE(tr_layout, 1, "## Local: \'" << Interner::spelling(variableName) << "\', type: " << bt_to_string(decl_type));
           currMethodOffset->insert(variableName, offset, wordsize, type);
         }
         offset = (offset - wordsize);
       }
     }
 
-    p->visit_children(this);
+    visit_children(p);
   }
   void visitParameterImpl(ParameterImpl *p) {}
   void visitAssignment(Assignment *p) {
-    fprintf(m_outputfile, "##### ASSIGNMENT\n");
-    p->visit_children(this);
+    SymId variableName = ((VariableIDImpl*)(p->m_variableid))->m_symname->id();
 
-    char* variableName = strdup(((VariableIDImpl*)(p->m_variableid))->m_symname->spelling());
+    if (m_ir) {
+      VReg value = lower(p->m_expression);
+      if(currMethodOffset->exist(variableName)){
+        m_ir->use(ir_store_local, value, no_vreg, currMethodOffset->get_offset(variableName));
+      } else {
+        VReg self = m_ir->def(ir_load_local, no_vreg, no_vreg, this_offset());
+        m_ir->use(ir_store_field, self, value, currClassOffset->get_offset(variableName));
+      }
+      return;
+    }
+
+    m_asm.emit("##### ASSIGNMENT\n");
+    visit_children(p);
 
     if(currMethodOffset->exist(variableName)){
       int offset = currMethodOffset->get_offset(variableName);
 
-      fprintf(m_outputfile, "        popl %%eax\n");
-      fprintf(m_outputfile, "        movl %%eax, %d(%%ebp)\n", offset);
+      m_asm.emit("        popl %%eax\n");
+      m_asm.emit("        movl %%eax, %d(%%ebp)\n", offset);
     } else {
       int offset = currClassOffset->get_offset(variableName);
 
-      // fprintf(m_outputfile, "        pushl %d(%%ecx)\n", offset);
-      cerr << "# ASSIGN variable: " << variableName << ", offset: " << offset << endl;
-      fprintf(m_outputfile, "        popl %%eax\n");
-      fprintf(m_outputfile, "        movl 8(%%ebp), %%ebx\n");
-      fprintf(m_outputfile, "        movl %%eax, %d(%%ebx)\n", offset);
+      // m_asm.emit("        pushl %d(%%ecx)\n", offset);
+      TRACE(tr_vars, 2, "# ASSIGN variable: " << Interner::spelling(variableName) << ", offset: " << offset);
+      m_asm.emit("        popl %%eax\n");
+      m_asm.emit("        movl 8(%%ebp), %%ebx\n");
+      m_asm.emit("        movl %%eax, %d(%%ebx)\n", offset);
     }
 
   }
   void visitIf(If *p) {
-    fprintf(m_outputfile, "##### IF ELSE\n");
+    // a folded predicate decides at compile time whether the body runs
+    LatticeElem & pred = m_attributes->lattice(p->m_expression);
+    if (pred.is_const) {
+      if (pred.value != 0) dispatch(p->m_statement);
+      return;
+    }
+
+    if (!m_ir) m_asm.emit("##### IF ELSE\n");
 
-    p->m_expression->accept(this);
     int label = new_label();
-    fprintf(m_outputfile, "        popl %%eax\n");
-    fprintf(m_outputfile, "        cmp $1, %%eax\n");
-    fprintf(m_outputfile, "        jne end%d\n", label);
-    p->m_statement->accept(this);
-    fprintf(m_outputfile, "end%d:\n", label);
+    branch(p->m_expression, false, label);
+    dispatch(p->m_statement);
+    emit_label(label);
 
   }
   void visitPrint(Print *p) {
-    fprintf(m_outputfile, "##### PRINT\n");
-    p->visit_children(this);
+    if (m_ir) {
+      m_ir->use(ir_print, lower(p->m_expression));
+      return;
+    }
+
+    m_asm.emit("##### PRINT\n");
+    visit_children(p);
 
     // TODO: acts kind of weird. does it though?
-    fprintf(m_outputfile, "        call Print\n");
+    m_asm.emit("        call Print\n");
   }
   void visitReturnImpl(ReturnImpl *p) {
-    p->visit_children(this);
+    if (m_ir) {
+      m_ir->use(ir_return, lower(p->m_expression));
+      return;
+    }
+
+    visit_children(p);
     // Store the return value
-    fprintf(m_outputfile, "        popl %%eax\n");
+    m_asm.emit("        popl %%eax\n");
 
     // EPILOGUE
-    cerr << "## epilogue" << endl;
+    TRACE(tr_frame, 1, "## epilogue");
+    // restore the caller's %ebx, saved just below the locals
+    m_asm.emit("        movl %d(%%ebp), %%ebx\n", -currMethodOffset->getTotalSize() - wordsize);
     // clean up  activation record
     // deallocating the local variable space allocated
-    fprintf(m_outputfile, "        addl $%d, %%esp\n", currMethodOffset->getTotalSize());
+    m_asm.emit("        addl $%d, %%esp\n", currMethodOffset->getTotalSize());
     // restoring the caller's activation record pointer
-    fprintf(m_outputfile, "        leave\n");
+    m_asm.emit("        leave\n");
     // returning to the return address
-    fprintf(m_outputfile, "        ret\n\n");
+    m_asm.emit("        ret\n\n");
   }
   void visitTInteger(TInteger *p) {
-    p->m_attribute.m_type.baseType = bt_integer;
+    type_of(p).baseType = bt_integer;
   }
   void visitTBoolean(TBoolean *p) {
-    p->m_attribute.m_type.baseType = bt_boolean;
+    type_of(p).baseType = bt_boolean;
   }
   void visitTNothing(TNothing *p) {
-    p->m_attribute.m_type.baseType = bt_nothing;
+    type_of(p).baseType = bt_nothing;
   }
   void visitTObject(TObject *p) {
-    p->m_attribute.m_type.baseType = bt_object;
+    type_of(p).baseType = bt_object;
   }
   void visitClassIDImpl(ClassIDImpl *p) {
-    // fprintf(m_outputfile, "####### CLASS ID\n");
+    // m_asm.emit("####### CLASS ID\n");
   }
   void visitVariableIDImpl(VariableIDImpl *p) {
-    // fprintf(m_outputfile, "####### VARIABLE ID\n");
+    // m_asm.emit("####### VARIABLE ID\n");
   }
   void visitMethodIDImpl(MethodIDImpl *p) {
-    // fprintf(m_outputfile, "####### METHOD ID\n");
+    // m_asm.emit("####### METHOD ID\n");
   }
   void visitPlus(Plus *p) {
-    fprintf(m_outputfile, "####### ADD\n");
+    if (emit_folded(p)) return;
+
+    if (m_ir) {
+      lower_binary(ir_add, p->m_expression_1, p->m_expression_2);
+      return;
+    }
 
-    p->visit_children(this);
+    m_asm.emit("####### ADD\n");
 
-    fprintf(m_outputfile, "        popl %%ebx\n");
-    fprintf(m_outputfile, "        popl %%eax\n");
-    fprintf(m_outputfile, "        addl %%ebx, %%eax\n");
-    fprintf(m_outputfile, "        pushl %%eax\n");
+    visit_children(p);
+
+    m_asm.emit("        popl %%ebx\n");
+    m_asm.emit("        popl %%eax\n");
+    m_asm.emit("        addl %%ebx, %%eax\n");
+    m_asm.emit("        pushl %%eax\n");
 
   }
   void visitMinus(Minus *p) {
-    fprintf(m_outputfile, "###### MINUS\n");
+    if (emit_folded(p)) return;
+
+    if (m_ir) {
+      lower_binary(ir_sub, p->m_expression_1, p->m_expression_2);
+      return;
+    }
 
-    p->visit_children(this);
+    m_asm.emit("###### MINUS\n");
 
-    fprintf(m_outputfile, "        popl %%ebx\n");
-    fprintf(m_outputfile, "        popl %%eax\n");
-    fprintf(m_outputfile, "        subl %%ebx, %%eax\n");
-    fprintf(m_outputfile, "        pushl %%eax\n");
+    visit_children(p);
+
+    m_asm.emit("        popl %%ebx\n");
+    m_asm.emit("        popl %%eax\n");
+    m_asm.emit("        subl %%ebx, %%eax\n");
+    m_asm.emit("        pushl %%eax\n");
 
   }
   void visitTimes(Times *p) {
-    fprintf(m_outputfile, "###### TIMES\n");
+    if (emit_folded(p)) return;
+
+    if (m_ir) {
+      lower_binary(ir_mul, p->m_expression_1, p->m_expression_2);
+      return;
+    }
 
-    p->visit_children(this);
+    m_asm.emit("###### TIMES\n");
+
+    visit_children(p);
     
-    fprintf(m_outputfile, "        popl %%ebx\n");
-    fprintf(m_outputfile, "        popl %%eax\n");
-    fprintf(m_outputfile, "        imull %%ebx, %%eax\n");
-    fprintf(m_outputfile, "        pushl %%eax\n");
+    m_asm.emit("        popl %%ebx\n");
+    m_asm.emit("        popl %%eax\n");
+    m_asm.emit("        imull %%ebx, %%eax\n");
+    m_asm.emit("        pushl %%eax\n");
 
   }
   void visitDivide(Divide *p) {
-    fprintf(m_outputfile, "###### DIVIDE\n");
+    if (emit_folded(p)) return;
 
-    p->visit_children(this);
-    
-    fprintf(m_outputfile, "        popl %%ebx\n");
-    fprintf(m_outputfile, "        popl %%eax\n");
-    fprintf(m_outputfile, "        cdq\n");
-    fprintf(m_outputfile, "        idivl %%ebx\n");
-    fprintf(m_outputfile, "        pushl %%eax\n");
+    if (m_ir) {
+      lower_binary(ir_div, p->m_expression_1, p->m_expression_2);
+      return;
+    }
 
-  }
-  void visitAnd(And *p) {
-    fprintf(m_outputfile, "###### AND\n");
+    m_asm.emit("###### DIVIDE\n");
 
-    p->visit_children(this);
+    visit_children(p);
     
-    fprintf(m_outputfile, "        popl %%ebx\n");
-    fprintf(m_outputfile, "        popl %%eax\n");
-    fprintf(m_outputfile, "        andl %%ebx, %%eax\n");
-    fprintf(m_outputfile, "        pushl %%eax\n");
+    m_asm.emit("        popl %%ebx\n");
+    m_asm.emit("        popl %%eax\n");
+    m_asm.emit("        cdq\n");
+    m_asm.emit("        idivl %%ebx\n");
+    m_asm.emit("        pushl %%eax\n");
 
   }
-  void visitLessThan(LessThan *p) {
-    p->visit_children(this);
+  // And short-circuits: the right side is only evaluated when the left
+  // one is true, otherwise the left side's 0 is the result
+  void visitAnd(And *p) {
+    if (emit_folded(p)) return;
 
-    int l = new_label();
+    int label = new_label();
+    if (m_ir) {
+      VReg result = lower(p->m_expression_1);
+      m_ir->use(ir_branch_false, result, no_vreg, label);
+      m_ir->move(result, lower(p->m_expression_2));
+      m_ir->use(ir_label, no_vreg, no_vreg, label);
+      m_value = result;
+      return;
+    }
 
-    fprintf(m_outputfile, "###### LessThan\n");
+    m_asm.emit("###### AND\n");
 
-    fprintf(m_outputfile, "        popl %%ebx\n");
-    fprintf(m_outputfile, "        popl %%eax\n");
-    fprintf(m_outputfile, "        cmp %%ebx, %%eax\n");
-    fprintf(m_outputfile, "        jl equal%d\n", l);
+    dispatch(p->m_expression_1);
+    m_asm.emit("        popl %%eax\n");
+    m_asm.emit("        testl %%eax, %%eax\n");
+    m_asm.emit("        je %s%d\n", m_label_prefix.c_str(), label);
+    dispatch(p->m_expression_2);
+    m_asm.emit("        popl %%eax\n");
+    m_asm.emit("%s%d:\n", m_label_prefix.c_str(), label);
+    m_asm.emit("        pushl %%eax\n");
 
-    fprintf(m_outputfile, "        pushl $0\n");
-    fprintf(m_outputfile, "        jmp end%d\n", l);
+  }
+  void visitLessThan(LessThan *p) {
+    if (emit_folded(p)) return;
 
-    fprintf(m_outputfile, "equal%d:\n", l);
-    fprintf(m_outputfile, "        pushl $1\n");
+    if (m_ir) {
+      lower_binary(ir_lt, p->m_expression_1, p->m_expression_2);
+      return;
+    }
+
+    visit_children(p);
 
-    fprintf(m_outputfile, "end%d:\n", l);
+    m_asm.emit("###### LessThan\n");
+    emit_setcc("setl");
 
   }
   void visitLessThanEqualTo(LessThanEqualTo *p) {
-    p->visit_children(this);
-
-    int l = new_label();
-    fprintf(m_outputfile, "###### LessThanEqualTo\n");
+    if (emit_folded(p)) return;
 
-    fprintf(m_outputfile, "        popl %%ebx\n");
-    fprintf(m_outputfile, "        popl %%eax\n");
-    fprintf(m_outputfile, "        cmp %%ebx, %%eax\n");
-    fprintf(m_outputfile, "        jle equal%d\n", l);
-
-    fprintf(m_outputfile, "        pushl $0\n");
-    fprintf(m_outputfile, "        jmp end%d\n", l);
+    if (m_ir) {
+      lower_binary(ir_le, p->m_expression_1, p->m_expression_2);
+      return;
+    }
 
-    fprintf(m_outputfile, "equal%d:\n", l);
-    fprintf(m_outputfile, "        pushl $1\n");
+    visit_children(p);
 
-    fprintf(m_outputfile, "end%d:\n", l);
+    m_asm.emit("###### LessThanEqualTo\n");
+    emit_setcc("setle");
 
   }
   void visitNot(Not *p) {
-    fprintf(m_outputfile, "###### NOT\n");
+    if (emit_folded(p)) return;
 
-    p->visit_children(this);
+    if (m_ir) {
+      m_value = m_ir->def(ir_not, lower(p->m_expression));
+      return;
+    }
+
+    m_asm.emit("###### NOT\n");
+
+    visit_children(p);
     
-    fprintf(m_outputfile, "        popl %%eax\n");
-    fprintf(m_outputfile, "        not %%eax\n");
-    fprintf(m_outputfile, "        pushl %%eax\n");
+    m_asm.emit("        popl %%eax\n");
+    m_asm.emit("        xorl $1, %%eax\n");
+    m_asm.emit("        pushl %%eax\n");
 
   }
   void visitUnaryMinus(UnaryMinus *p) {
-    fprintf(m_outputfile, "###### AND\n");
+    if (emit_folded(p)) return;
+
+    if (m_ir) {
+      m_value = m_ir->def(ir_neg, lower(p->m_expression));
+      return;
+    }
+
+    m_asm.emit("###### AND\n");
 
-    p->visit_children(this);
+    visit_children(p);
     
-    fprintf(m_outputfile, "        popl %%eax\n");
-    fprintf(m_outputfile, "        negl %%eax\n");
-    fprintf(m_outputfile, "        pushl %%eax\n");
+    m_asm.emit("        popl %%eax\n");
+    m_asm.emit("        negl %%eax\n");
+    m_asm.emit("        pushl %%eax\n");
 
   }
   void visitMethodCall(MethodCall *p) {
     MethodIDImpl* m = ((MethodIDImpl*)p->m_methodid);
     visitMethodIDImpl(m);
-    char* methodName = strdup(m->m_symname->spelling());
-
-    // Push arguments on the stack
-    int param_size = p->m_expression_list->size();
-    list<Expression_ptr>::reverse_iterator exp_i;
-    forallr(exp_i, p->m_expression_list){
-      cerr << "# parameter" << endl;
-      (*exp_i)->accept(this);
-    }
-
-    char* variableName = strdup(((VariableIDImpl*)(p->m_variableid))->m_symname->spelling());
+    SymId methodName = m->m_symname->id();
+    SymId variableName = ((VariableIDImpl*)(p->m_variableid))->m_symname->id();
     int offset;
     CompoundType type;
-    if(currMethodOffset->exist(variableName)){
-      type = currMethodOffset->get_type(variableName);
-      offset = currMethodOffset->get_offset(variableName);
-    } else {
-      if(currClassOffset->exist(variableName)){
-        type = currClassOffset->get_type(variableName);
-        offset = currClassOffset->get_offset(variableName);  
+
+    if (m_ir) {
+      std::vector<VReg> args;
+      lower_arguments(p->m_expression_list, args);
+
+      resolve_call(variableName, methodName, offset, type);
+      VReg object;
+      if(currMethodOffset->exist(variableName)){
+        object = m_ir->def(ir_load_local, no_vreg, no_vreg, offset);
       } else {
-        // what if variable is in parent class? Do we just copy it over?   
+        VReg self = m_ir->def(ir_load_local, no_vreg, no_vreg, this_offset());
+        object = m_ir->def(ir_load_field, self, no_vreg, offset);
       }
+      lower_call(args, object, type.classID, methodName);
+      return;
     }
 
-    ClassNode* current_class = m_classtable->lookup(type.classID);
-    while( strcmp(current_class->name->spelling(), "TopClass") != 0 && current_class->scope != NULL){
-      if(current_class->scope->exist(methodName)){
-        type.classID = current_class->name->spelling();
-        break;
-      }
-      current_class = m_classtable->getParentOf(current_class->name);
+    // Push arguments on the stack
+    int param_size = p->m_expression_list->size();
+    Expression_list::reverse_iterator exp_i;
+    forallr(exp_i, p->m_expression_list){
+      TRACE(tr_calls, 2, "# parameter");
+      dispatch(*exp_i);
     }
 
-    cerr << "# MethodCall, class name: " << type.classID
-        << ", objName: " << variableName
-        << ", offset: " << offset << endl;
+    resolve_call(variableName, methodName, offset, type);
+
+    TRACE(tr_calls, 2, "# MethodCall, class name: " << Interner::spelling(type.classID)
+          << ", objName: " << Interner::spelling(variableName)
+          << ", offset: " << offset);
 
-    fprintf(m_outputfile, "        pushl %d(%%ebp)\n", offset);
+    // the object is a local or a field of this, as in visitVariable
+    if(currMethodOffset->exist(variableName)){
+      m_asm.emit("        pushl %d(%%ebp)\n", offset);
+    } else {
+      m_asm.emit("        movl 8(%%ebp), %%eax\n");
+      m_asm.emit("        pushl %d(%%eax)\n", offset);
+    }
     // Push return address
     // Call the function
-    fprintf(m_outputfile, "        call %s_%s\n", type.classID, methodName);
+    m_asm.emit("        call %s_%s\n", Interner::spelling(type.classID), Interner::spelling(methodName));
 
     // POST-CALL
-    cerr << "## post-call" << endl;
-    fprintf(m_outputfile, "        addl $%d, %%esp\n", (param_size+1)*wordsize);
+    TRACE(tr_calls, 2, "## post-call");
+    m_asm.emit("        addl $%d, %%esp\n", (param_size+1)*wordsize);
 
     // Put return value onto stack
-    fprintf(m_outputfile, "        pushl %%eax\n");
+    m_asm.emit("        pushl %%eax\n");
 
   }
   void visitSelfCall(SelfCall *p) {
+    if (m_ir) {
+      std::vector<VReg> args;
+      lower_arguments(p->m_expression_list, args);
+      VReg self = m_ir->def(ir_load_local, no_vreg, no_vreg, this_offset());
+      SymId methodName = ((MethodIDImpl*)p->m_methodid)->m_symname->id();
+      lower_call(args, self, defining_class(currClassName, methodName), methodName);
+      return;
+    }
 
-         // WRITEME
     // PRE-CALL
-    cerr << "## pre-call" << endl;
+    TRACE(tr_calls, 2, "## pre-call");
     // Push arguments on the stack
     int param_size = p->m_expression_list->size();
-    list<Expression_ptr>::reverse_iterator exp_i;
+    Expression_list::reverse_iterator exp_i;
     forallr(exp_i, p->m_expression_list){
-      cerr << "# parameter" << endl;
-      (*exp_i)->accept(this);
+      TRACE(tr_calls, 2, "# parameter");
+      dispatch(*exp_i);
     }
 
     // Push return address
-    fprintf(m_outputfile, "        pushl 8(%%ebp)\n");
+    m_asm.emit("        pushl 8(%%ebp)\n");
 
     // Call the function
     MethodIDImpl* m = ((MethodIDImpl*)p->m_methodid);
     visitMethodIDImpl(m);
-    char* methodName = strdup(m->m_symname->spelling());
-    fprintf(m_outputfile, "        call %s_%s\n", currClassName, methodName);
+    SymId methodName = m->m_symname->id();
+    m_asm.emit("        call %s_%s\n", Interner::spelling(defining_class(currClassName, methodName)), Interner::spelling(methodName));
 
     // POST-CALL
-    cerr << "## post-call" << endl;
-    // are we clearing arguments here?
-    fprintf(m_outputfile, "        addl $%d, %%esp\n", param_size*wordsize);
+    TRACE(tr_calls, 2, "## post-call");
+    // clear the arguments and the self pointer
+    m_asm.emit("        addl $%d, %%esp\n", (param_size+1)*wordsize);
 
     // Put return value onto stack
-    fprintf(m_outputfile, "        pushl %%eax\n");
+    m_asm.emit("        pushl %%eax\n");
 
   }
   void visitVariable(Variable *p) {
 
          // WRITEME
-    char* variableName = strdup(((VariableIDImpl*)(p->m_variableid))->m_symname->spelling());
+    if (emit_folded(p)) return;
+
+    SymId variableName = ((VariableIDImpl*)(p->m_variableid))->m_symname->id();
+    if (m_ir) {
+      if(currMethodOffset->exist(variableName)){
+        m_value = m_ir->def(ir_load_local, no_vreg, no_vreg, currMethodOffset->get_offset(variableName));
+      } else {
+        VReg self = m_ir->def(ir_load_local, no_vreg, no_vreg, this_offset());
+        m_value = m_ir->def(ir_load_field, self, no_vreg, currClassOffset->get_offset(variableName));
+      }
+      return;
+    }
     if(currMethodOffset->exist(variableName)){
       int offset = currMethodOffset->get_offset(variableName);
-      int size = currMethodOffset->get_size(variableName);
       // CompoundType type = currMethodOffset->get_type(variableName);
 
-      cerr << "# L variable: " << variableName << ", offset: " << offset
-           << ", size: " << size << endl;
-      fprintf(m_outputfile, "        pushl %d(%%ebp)\n", offset);
+      TRACE(tr_vars, 2, "# L variable: " << Interner::spelling(variableName) << ", offset: " << offset
+            << ", size: " << currMethodOffset->get_size(variableName));
+      m_asm.emit("        pushl %d(%%ebp)\n", offset);
     } else {
       int offset = currClassOffset->get_offset(variableName);
-      int size = currClassOffset->get_size(variableName);
       // CompoundType type = currClassOffset->get_type(variableName);
 
-      cerr << "# CL variable: " << variableName << ", offset: " << offset << endl;
-      // fprintf(m_outputfile, "        pushl %d(%%ecx)\n", offset);
-      fprintf(m_outputfile, "        movl 8(%%ebp), %%eax\n");
-      fprintf(m_outputfile, "        pushl %d(%%eax)\n", offset);
+      TRACE(tr_vars, 2, "# CL variable: " << Interner::spelling(variableName) << ", offset: " << offset);
+      // m_asm.emit("        pushl %d(%%ecx)\n", offset);
+      m_asm.emit("        movl 8(%%ebp), %%eax\n");
+      m_asm.emit("        pushl %d(%%eax)\n", offset);
     }
 
   }
   void visitIntegerLiteral(IntegerLiteral *p) {
-    fprintf(m_outputfile, "####### INT literal\n");
-    fprintf(m_outputfile, "        pushl $%d\n", p->m_primitive->m_data);
+    if (m_ir) {
+      m_value = m_ir->def(ir_const, no_vreg, no_vreg, p->m_primitive->m_data);
+      return;
+    }
+    m_asm.emit("####### INT literal\n");
+    m_asm.emit("        pushl $%d\n", p->m_primitive->m_data);
 
   }
   void visitBooleanLiteral(BooleanLiteral *p) {
-    fprintf(m_outputfile, "####### BOOL literal\n");
-    fprintf(m_outputfile, "        pushl $%d\n", p->m_primitive->m_data);
+    if (m_ir) {
+      m_value = m_ir->def(ir_const, no_vreg, no_vreg, p->m_primitive->m_data);
+      return;
+    }
+    m_asm.emit("####### BOOL literal\n");
+    m_asm.emit("        pushl $%d\n", p->m_primitive->m_data);
 
   }
   void visitNothing(Nothing *p) {
 
          // WRITEME
+    if (m_ir) m_value = m_ir->def(ir_const, no_vreg, no_vreg, 0);
 
   }
   void visitSymName(SymName *p) {
@@ -0,0 +1,11 @@
+#ifndef COMPILEERROR_HPP
+#define COMPILEERROR_HPP
+
+// Thrown when the program being compiled has an error, once the message
+// has been printed.  It unwinds to the driver, which gives up on that one
+// input (and goes on with the others) instead of exiting the process.
+struct CompileError
+{
+};
+
+#endif //COMPILEERROR_HPP
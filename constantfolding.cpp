@@ -0,0 +1,290 @@
+#include "ast.hpp"
+#include "symtab.hpp"
+#include "primitive.hpp"
+#include "attribute.hpp"
+#include "classunits.hpp"
+#include <limits.h>
+#include <map>
+#include <set>
+
+/***********
+
+    Constant propagation runs between the type checker and the code
+    generator.  It walks each method body in the order the generated code
+    evaluates it, keeping track of the integer and boolean variables that
+    are known to hold a constant, and records in the AttributeTable every
+    expression whose value it can work out at compile time.  Codegen then
+    pushes that constant instead of computing the expression, and leaves
+    out an If whose predicate is known to be false.
+
+    The rules:
+      * every variable is TOP when a method starts (the analysis is
+        intraprocedural, so parameters and fields are unknown, and locals
+        start out uninitialized)
+      * an assignment gives its variable the value of the right hand side
+      * a call may change any field of any object, so the fields are TOP
+        again after each call; locals and parameters live in the frame and
+        keep their value
+      * after an If the variables are joined: a variable stays constant
+        only if it has the same value whether or not the body ran; the
+        same goes for the right side of an And, which only runs when the
+        left side is true
+      * an expression is folded only when all its operands are constant
+        (or, for And, when its left side is false and the right side would
+        not run anyway), so folding never drops a call; a division by zero
+        (which traps at run time) is left alone
+
+    The folded values are exactly what the generated code would compute:
+    arithmetic wraps around at the word size of the target, the
+    comparisons give 1 or 0, And works on the bits of the value, and Not
+    flips a boolean between 0 and 1.
+
+*****/
+
+class ConstantFolding final : public Visitor, public StaticVisitor<ConstantFolding> {
+    private:
+    AttributeTable* m_attributes;
+    int m_bits; // bits in a word of the target
+    ClassUnits* m_units; // the classes whose code is in the cache, or NULL
+
+    // LatticeElemMap: the variables of the current method known to be
+    // constant at this point; a variable that is not in here is TOP
+    typedef std::map<SymId, long long> LatticeElemMap;
+    LatticeElemMap m_known;
+
+    // the parameters and locals of the current method
+    std::set<SymId> m_locals;
+
+    template <class Node>
+    LatticeElem& lattice_of(Node* p) { return m_attributes->lattice(p); }
+
+    SymId name_of(VariableID* v) { return ((VariableIDImpl*)v)->m_symname->id(); }
+
+    void set_const(Expression* p, long long value) {
+      lattice_of(p).is_const = true;
+      lattice_of(p).value = value;
+    }
+
+    // visits both operands of a binary expression; true if both are constant
+    bool fold_operands(Expression* l, Expression* r, long long & a, long long & b) {
+      dispatch(l);
+      dispatch(r);
+      if ( !lattice_of(l).is_const || !lattice_of(r).is_const ) return false;
+      a = lattice_of(l).value;
+      b = lattice_of(r).value;
+      return true;
+    }
+
+    // a call can reach the fields of any object, but not our frame
+    void forget_fields() {
+      LatticeElemMap::iterator i = m_known.begin();
+      while ( i != m_known.end() ) {
+        if ( m_locals.count(i->first) ) i++;
+        else m_known.erase(i++);
+      }
+    }
+
+    // keeps the variables that have the same value in both maps
+    static void join_lattice_elem_maps(LatticeElemMap & into, const LatticeElemMap & other) {
+      LatticeElemMap::iterator i = into.begin();
+      while ( i != into.end() ) {
+        LatticeElemMap::const_iterator o = other.find(i->first);
+        if ( o != other.end() && o->second == i->second ) i++;
+        else into.erase(i++);
+      }
+    }
+
+    // the call's arguments are evaluated last to first, like Codegen does
+    void visit_arguments(Expression_list* args) {
+      Expression_list::reverse_iterator exp_i;
+      for(exp_i = args->rbegin(); exp_i != args->rend(); exp_i++)
+        dispatch(*exp_i);
+    }
+
+    // wraps around at the word size, as the machine does it
+    long long wrap(unsigned long long v) {
+      if ( m_bits == 32 ) return (int)(unsigned)v;
+      return (long long)v;
+    }
+    long long wrap_add(long long a, long long b) { return wrap((unsigned long long)a + (unsigned long long)b); }
+    long long wrap_sub(long long a, long long b) { return wrap((unsigned long long)a - (unsigned long long)b); }
+    long long wrap_mul(long long a, long long b) { return wrap((unsigned long long)a * (unsigned long long)b); }
+
+    public:
+
+    ConstantFolding(AttributeTable* at, int word_bits, ClassUnits* units = NULL) {
+      m_attributes = at;
+      m_bits = word_bits;
+      m_units = units;
+    }
+
+    void visitProgramImpl(ProgramImpl *p) {
+      visit_children(p);
+    }
+
+    void visitClassImpl(ClassImpl *p) {
+      // Codegen does not look at a class it has the code of
+      if ( m_units && m_units->clean(((ClassIDImpl*)p->m_classid_1)->m_classname->id()) ) return;
+
+      Method_list::iterator meth_i;
+      for(meth_i = p->m_method_list->begin(); meth_i != p->m_method_list->end(); meth_i++)
+        dispatch(*meth_i);
+    }
+
+    void visitDeclarationImpl(DeclarationImpl *p) {
+      VariableID_list::iterator var_i;
+      for(var_i = p->m_variableid_list->begin(); var_i != p->m_variableid_list->end(); var_i++)
+        m_locals.insert(name_of(*var_i));
+    }
+
+    void visitMethodImpl(MethodImpl *p) {
+      // a fresh analysis for every method
+      m_known.clear();
+      m_locals.clear();
+      visit_children(p);
+    }
+
+    void visitMethodBodyImpl(MethodBodyImpl *p) {
+      visit_children(p);
+    }
+
+    void visitParameterImpl(ParameterImpl *p) {
+      m_locals.insert(name_of(p->m_variableid));
+    }
+
+    void visitAssignment(Assignment *p) {
+      dispatch(p->m_expression);
+
+      SymId name = name_of(p->m_variableid);
+      if ( lattice_of(p->m_expression).is_const ) m_known[name] = lattice_of(p->m_expression).value;
+      else m_known.erase(name);
+    }
+
+    void visitIf(If *p) {
+      dispatch(p->m_expression);
+
+      // the body runs when the predicate is not 0
+      LatticeElem pred = lattice_of(p->m_expression);
+      if ( pred.is_const ) {
+        if ( pred.value != 0 ) dispatch(p->m_statement);
+        return;
+      }
+
+      LatticeElemMap skipped = m_known;
+      dispatch(p->m_statement);
+      join_lattice_elem_maps(m_known, skipped);
+    }
+
+    void visitPrint(Print *p) {
+      visit_children(p);
+    }
+
+    void visitReturnImpl(ReturnImpl *p) {
+      visit_children(p);
+    }
+
+    void visitTInteger(TInteger *p) {}
+    void visitTBoolean(TBoolean *p) {}
+    void visitTNothing(TNothing *p) {}
+    void visitTObject(TObject *p) {}
+    void visitClassIDImpl(ClassIDImpl *p) {}
+    void visitVariableIDImpl(VariableIDImpl *p) {}
+    void visitMethodIDImpl(MethodIDImpl *p) {}
+
+    void visitPlus(Plus *p) {
+      long long a, b;
+      if ( fold_operands(p->m_expression_1, p->m_expression_2, a, b) ) set_const(p, wrap_add(a, b));
+    }
+
+    void visitMinus(Minus *p) {
+      long long a, b;
+      if ( fold_operands(p->m_expression_1, p->m_expression_2, a, b) ) set_const(p, wrap_sub(a, b));
+    }
+
+    void visitTimes(Times *p) {
+      long long a, b;
+      if ( fold_operands(p->m_expression_1, p->m_expression_2, a, b) ) set_const(p, wrap_mul(a, b));
+    }
+
+    void visitDivide(Divide *p) {
+      long long a, b;
+      if ( !fold_operands(p->m_expression_1, p->m_expression_2, a, b) ) return;
+      long long min = (m_bits == 32) ? INT_MIN : LLONG_MIN;
+      if ( b == 0 || (a == min && b == -1) ) return; // idiv traps on these
+      set_const(p, a / b);
+    }
+
+    // the right side only runs when the left one is true
+    void visitAnd(And *p) {
+      dispatch(p->m_expression_1);
+      LatticeElem left = lattice_of(p->m_expression_1);
+      if ( left.is_const && left.value == 0 ) {
+        set_const(p, 0);
+        return;
+      }
+
+      if ( left.is_const ) {
+        dispatch(p->m_expression_2);
+      } else {
+        LatticeElemMap skipped = m_known;
+        dispatch(p->m_expression_2);
+        join_lattice_elem_maps(m_known, skipped);
+      }
+
+      LatticeElem right = lattice_of(p->m_expression_2);
+      if ( left.is_const && right.is_const ) set_const(p, left.value & right.value);
+    }
+
+    void visitLessThan(LessThan *p) {
+      long long a, b;
+      if ( fold_operands(p->m_expression_1, p->m_expression_2, a, b) ) set_const(p, a < b);
+    }
+
+    void visitLessThanEqualTo(LessThanEqualTo *p) {
+      long long a, b;
+      if ( fold_operands(p->m_expression_1, p->m_expression_2, a, b) ) set_const(p, a <= b);
+    }
+
+    void visitNot(Not *p) {
+      dispatch(p->m_expression);
+      if ( lattice_of(p->m_expression).is_const ) set_const(p, lattice_of(p->m_expression).value ^ 1);
+    }
+
+    void visitUnaryMinus(UnaryMinus *p) {
+      dispatch(p->m_expression);
+      if ( lattice_of(p->m_expression).is_const ) set_const(p, wrap_sub(0, lattice_of(p->m_expression).value));
+    }
+
+    void visitMethodCall(MethodCall *p) {
+      visit_arguments(p->m_expression_list);
+      forget_fields();
+    }
+
+    void visitSelfCall(SelfCall *p) {
+      visit_arguments(p->m_expression_list);
+      forget_fields();
+    }
+
+    void visitVariable(Variable *p) {
+      LatticeElemMap::iterator i = m_known.find(name_of(p->m_variableid));
+      if ( i != m_known.end() ) set_const(p, i->second);
+    }
+
+    void visitIntegerLiteral(IntegerLiteral *p) {
+      set_const(p, p->m_primitive->m_data);
+    }
+
+    void visitBooleanLiteral(BooleanLiteral *p) {
+      set_const(p, p->m_primitive->m_data);
+    }
+
+    void visitNothing(Nothing *p) {}
+
+    void visitSymName(SymName *p) {}
+
+    void visitPrimitive(Primitive *p) {}
+
+    void visitClassName(ClassName *p) {}
+
+    void visitNullPointer() {}
+};
@@ -0,0 +1,144 @@
+#include "intern.hpp"
+#include <cstring>
+#include <cstdlib>
+#include <assert.h>
+
+/****** Interner Implementation **************************************/
+
+static const size_t pool_chunk_size = 64 * 1024;
+static const size_t initial_slots = 1024; // must be a power of two
+
+static unsigned int hash_spelling(const char* s, size_t len)
+{
+	//FNV-1a
+	unsigned int h = 2166136261u;
+	for( size_t i=0; i<len; i++ ) {
+		h ^= (unsigned char)s[i];
+		h *= 16777619u;
+	}
+	return h;
+}
+
+Interner::Interner()
+{
+	m_count = 0;
+	m_pool_left = 0;
+	m_pool_next = NULL;
+	m_slots.assign(initial_slots, sym_none);
+
+	// slot 0 of the id space is reserved for sym_none
+	add("", 0, 0);
+}
+
+Interner& Interner::instance()
+{
+	static Interner the_interner;
+	return the_interner;
+}
+
+const char* Interner::save(const char* s, size_t len)
+{
+	if ( len+1 > m_pool_left ) {
+		size_t chunk = (len+1 > pool_chunk_size) ? len+1 : pool_chunk_size;
+		m_pool_next = (char*)malloc(chunk);
+		assert( m_pool_next != NULL );
+		m_pool.push_back(m_pool_next);
+		m_pool_left = chunk;
+	}
+	char* r = m_pool_next;
+	memcpy(r, s, len);
+	r[len] = '\0';
+	m_pool_next += len+1;
+	m_pool_left -= len+1;
+	return r;
+}
+
+void Interner::grow()
+{
+	//rehash every id into a table twice the size, using the
+	//hashes we remembered so no spelling is looked at again
+	std::vector<SymId> slots(m_slots.size()*2, sym_none);
+	size_t mask = slots.size()-1;
+	for( SymId id=1; id<m_count; id++ ) {
+		size_t i = m_hash[id] & mask;
+		while( slots[i] != sym_none ) i = (i+1) & mask;
+		slots[i] = id;
+	}
+	m_slots.swap(slots);
+}
+
+//stores the entry for the next id (with the lock held)
+void Interner::add(const char* s, size_t len, unsigned int h)
+{
+	SymId id = m_count;
+	if ( (id & (block_size-1)) == 0 ) {
+		assert( (id >> block_bits) < max_blocks );
+		m_blocks[id >> block_bits] = new Entry[block_size];
+	}
+	entry(id).spelling = save(s, len);
+	entry(id).length = len;
+	m_hash.push_back(h);
+	m_count = id+1;
+}
+
+//the slot holding the id of the len characters at s (with hash h), or
+//the empty slot where it would go (with the lock held)
+size_t Interner::probe(const char* s, size_t len, unsigned int h)
+{
+	size_t mask = m_slots.size()-1;
+	size_t i = h & mask;
+	while( m_slots[i] != sym_none ) {
+		SymId id = m_slots[i];
+		if ( m_hash[id] == h && entry(id).length == len
+		     && memcmp(entry(id).spelling, s, len) == 0 ) {
+			break;
+		}
+		i = (i+1) & mask;
+	}
+	return i;
+}
+
+SymId Interner::intern(const char* s, size_t len)
+{
+	Interner& in = instance();
+	unsigned int h = hash_spelling(s, len);
+	std::lock_guard<std::mutex> hold(in.m_lock);
+	size_t i = in.probe(s, len, h);
+	if ( in.m_slots[i] != sym_none ) return in.m_slots[i];
+
+	SymId id = in.m_count;
+	in.add(s, len, h);
+	in.m_slots[i] = id;
+
+	//keep the load factor under one half
+	if ( in.m_count*2 > in.m_slots.size() ) in.grow();
+	return id;
+}
+
+SymId Interner::intern(const char* s)
+{
+	assert( s != NULL );
+	return intern(s, strlen(s));
+}
+
+SymId Interner::find(const char* s, size_t len)
+{
+	Interner& in = instance();
+	unsigned int h = hash_spelling(s, len);
+	std::lock_guard<std::mutex> hold(in.m_lock);
+	return in.m_slots[in.probe(s, len, h)];
+}
+
+const char* Interner::spelling(SymId id)
+{
+	Interner& in = instance();
+	assert( id < in.m_count );
+	return in.entry(id).spelling;
+}
+
+size_t Interner::length(SymId id)
+{
+	Interner& in = instance();
+	assert( id < in.m_count );
+	return in.entry(id).length;
+}
@@ -0,0 +1,75 @@
+#ifndef INTERN_HPP
+#define INTERN_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <mutex>
+#include <vector>
+
+// every identifier spelling seen by the compiler is interned exactly once
+// and from then on referred to by a small integer.  Id 0 is never handed
+// out, so it can be used to mean "no symbol".
+typedef unsigned int SymId;
+
+static const SymId sym_none = 0;
+
+// This is the process-wide identifier table.  The lexer feeds it every
+// IDMETHVAR/IDCLASS token, and the symbol, class and offset tables all key
+// on the resulting SymId, so the text of a name is only hashed once (when
+// it is scanned).  Spellings are kept in a pool that is never freed, which
+// means the pointer returned by spelling() is stable for the life of the
+// process.
+//
+// Several threads may compile at once: intern() takes a lock, while
+// spelling() and length() do not need one.  An id only becomes known to a
+// thread through intern(), which has already stored its entry, and entries
+// live in blocks that never move.
+class Interner
+{
+  private:
+  struct Entry
+  {
+    const char* spelling;
+    size_t length;
+  };
+
+  static const size_t block_bits = 12;
+  static const size_t block_size = 1 << block_bits;
+  static const size_t max_blocks = 1 << 16;
+
+  Entry* m_blocks[max_blocks];         // indexed by SymId >> block_bits
+  std::atomic<SymId> m_count;          // ids handed out, counting sym_none
+  std::vector<unsigned int> m_hash;    // indexed by SymId
+  std::vector<SymId> m_slots;          // open addressing, 0 == empty
+  std::mutex m_lock;                   // held while looking up or adding
+
+  std::vector<char*> m_pool;           // chunks holding the spellings
+  size_t m_pool_left;
+  char* m_pool_next;
+
+  Entry& entry(SymId id) { return m_blocks[id >> block_bits][id & (block_size-1)]; }
+  void add(const char* s, size_t len, unsigned int h);
+  size_t probe(const char* s, size_t len, unsigned int h);
+
+  Interner();
+  const char* save(const char* s, size_t len);
+  void grow();
+
+  static Interner& instance();
+
+  public:
+
+  //returns the id for the len characters at s, adding them
+  //to the table if they have never been seen before
+  static SymId intern(const char* s, size_t len);
+  static SymId intern(const char* s);
+  //the id of the len characters at s if they have been interned, or
+  //sym_none; never adds anything
+  static SymId find(const char* s, size_t len);
+
+  //the NUL terminated spelling of an interned id
+  static const char* spelling(SymId id);
+  static size_t length(SymId id);
+};
+
+#endif //INTERN_HPP
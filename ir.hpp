@@ -0,0 +1,94 @@
+#ifndef IR_HPP
+#define IR_HPP
+
+#include <vector>
+#include "intern.hpp"
+
+// The lowered form of one method used by the register allocating code
+// generator.  Codegen turns the statements and expressions of a method
+// body into a linear list of three-address instructions over an unbounded
+// supply of virtual registers; LinearScan (regalloc.hpp) then maps those
+// onto the machine registers.  Every virtual register is defined by
+// exactly one instruction, except that ir_move may assign it again further
+// down (the join of a short-circuit And); since the language has no loops
+// all branches go forward.
+
+typedef int VReg;
+static const VReg no_vreg = -1;
+
+enum IrOp
+{
+	ir_const,        // dst = imm
+	ir_move,         // dst = a, where dst was defined before
+	ir_load_local,   // dst = the word at frame offset imm
+	ir_store_local,  // the word at frame offset imm = a
+	ir_load_field,   // dst = the word at offset imm from object a
+	ir_store_field,  // the word at offset imm from object a = b
+	ir_add,          // dst = a + b
+	ir_sub,          // dst = a - b
+	ir_mul,          // dst = a * b
+	ir_div,          // dst = a / b
+	ir_lt,           // dst = (a < b)
+	ir_le,           // dst = (a <= b)
+	ir_neg,          // dst = -a
+	ir_not,          // dst = !a (a is 0 or 1)
+	ir_arg,          // pass a as the next outgoing argument (last one first,
+	                 // all of a call's arguments right before the ir_call)
+	ir_call,         // dst = call of cls_meth, then pop imm bytes of arguments (i386)
+	ir_print,        // print a
+	ir_alloc,        // dst = imm fresh bytes from the heap
+	ir_label,        // label number imm
+	ir_jump,         // goto label imm
+	ir_branch_false, // if a == 0 goto label imm
+	ir_branch_true,  // if a != 0 goto label imm
+	ir_branch_lt,    // if a < b goto label imm
+	ir_branch_le,    // if a <= b goto label imm
+	ir_branch_ge,    // if a >= b goto label imm
+	ir_branch_gt,    // if a > b goto label imm
+	ir_return        // return a from the method
+};
+
+struct IrInst
+{
+	IrOp op;
+	VReg dst;
+	VReg a, b;
+	long long imm;   // a constant (a whole word), or an offset, label or size
+	SymId cls, meth; // target of ir_call
+};
+
+class IrFunction
+{
+  public:
+  std::vector<IrInst> m_code;
+  int m_vreg_count;
+
+  IrFunction() { m_vreg_count = 0; }
+
+  //appends an instruction that defines a fresh virtual register
+  VReg def(IrOp op, VReg a = no_vreg, VReg b = no_vreg, long long imm = 0) {
+	IrInst i = { op, m_vreg_count++, a, b, imm, sym_none, sym_none };
+	m_code.push_back(i);
+	return i.dst;
+  }
+
+  //appends an instruction that only has an effect
+  void use(IrOp op, VReg a = no_vreg, VReg b = no_vreg, long long imm = 0) {
+	IrInst i = { op, no_vreg, a, b, imm, sym_none, sym_none };
+	m_code.push_back(i);
+  }
+
+  //assigns a to an already defined virtual register
+  void move(VReg dst, VReg a) {
+	IrInst i = { ir_move, dst, a, no_vreg, 0, sym_none, sym_none };
+	m_code.push_back(i);
+  }
+
+  VReg call(SymId cls, SymId meth, int arg_bytes) {
+	IrInst i = { ir_call, m_vreg_count++, no_vreg, no_vreg, arg_bytes, cls, meth };
+	m_code.push_back(i);
+	return i.dst;
+  }
+};
+
+#endif //IR_HPP
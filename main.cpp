@@ -7,41 +7,403 @@
 #include "ast.hpp"
 #include "parser.hpp"
 #include "typecheck.cpp" 
+#include "constantfolding.cpp"
 #include "codegen.cpp"
+#include "timereport.hpp"
+#include "threadpool.hpp"
+#include "compileerror.hpp"
+#include "parsecontext.hpp"
+#include "source.hpp"
+#include "cache.hpp"
+#include "classunits.hpp"
 #include <assert.h>
+#include <string.h>
+#include <stdlib.h>
+#include <ctype.h>
+#include <unistd.h>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
 
 extern int yydebug; // set this to 1 if you want yyparse to dump a trace
-extern int yyparse(); // this actually the parser which then calls the scanner
 
-Program_ptr ast; // make sure to set to the final syntax tree in parser.ypp
 void dopass_ast2dot(Program_ptr ast); // this is defined in ast2dot.cpp
 
-void dopass_typecheck(Program_ptr ast, SymTab* st, ClassTable* ct) {
-        Typecheck* typecheck = new Typecheck(stderr, st, ct); //create the visitor
-        ast->accept(typecheck); //walk the tree with the visitor above
+void dopass_typecheck(Program_ptr ast, SymTab* st, ClassTable* ct, AttributeTable* at, FILE* diag, const char* symtab_dump, ClassUnits* units) {
+        Typecheck typecheck(diag, st, ct, at, symtab_dump, units); //create the visitor
+        typecheck.dispatch(ast); //walk the tree with the visitor above
 }
 
-void dopass_codegen(Program_ptr ast, SymTab* st, ClassTable* ct) {
-        Codegen* codegen = new Codegen(stderr, st, ct); //create the visitor
-        ast->accept(codegen); //walk the tree with the visitor above
-	delete codegen;
+void dopass_constantfolding(Program_ptr ast, AttributeTable* at, Target target, ClassUnits* units) {
+        ConstantFolding folding(at, (target == tg_x86_64) ? 64 : 32, units); //create the visitor
+        folding.dispatch(ast); //walk the tree with the visitor above
 }
 
-int main(void) {
-    SymTab st; //symbol table 
+void dopass_codegen(Program_ptr ast, SymTab* st, ClassTable* ct, AttributeTable* at, CodegenMode mode, Target target, int opt_level, OutputBuffer* out, Assembler* object, ClassUnits* units) {
+        Codegen codegen(out, st, ct, at, mode, target, opt_level, object, units); //create the visitor
+        codegen.dispatch(ast); //walk the tree with the visitor above
+}
+
+// what the command line asked for, the same for every input
+struct Options
+{
+    int opt_level;
+    CodegenMode mode;
+    Target target;
+    bool emit_asm;
+    bool dump_ast;
+    const char* symtab_dump;
+    const char* time_report;
+    CompileCache* cache;      // NULL without -fcache
+    const char* cache_config; // the options above, as part of the cache key
+    bool incremental;         // also cache every class on its own
+};
+
+// runs the passes over one input, appending the code to out; errors are
+// printed to diag.  false if the input had errors
+static bool generate(const Options & opts, SourceFile & input, OutputBuffer* out, FILE* diag, TimeReport & report) {
+    // -fdump-symtab needs every scope, which only the tree keeps
+    SymTab st(opts.symtab_dump ? st_tree : st_flat); //symbol table 
     ClassTable ct;
+    ClassUnits* units = NULL;
+    bool ok = true;
+
+    try {
+        // the parse builds the syntax tree in the current arena; it has a
+        // scanner and parser state of its own, so other compilations can
+        // be parsing at the same time
+        ParseContext parse(diag);
+        report.begin("parse");
+        Program_ptr tree = parse.parse(input.data(), input.size());
+        report.end();
+
+        // one slot per node built by the parse
+        AttributeTable at(parse.node_count);
+
+        // the classes that are in the cache on their own are not compiled
+        // again
+        if ( opts.cache && opts.incremental ) {
+            report.begin("units");
+            units = new ClassUnits((ProgramImpl*)tree, opts.cache, opts.cache_config);
+            report.end();
+            char classes[64];
+            snprintf(classes, sizeof(classes), "%d of %d compiled", units->compiled(), units->classes());
+            report.note("classes", classes);
+        }
+
+        // walk over the ast and print it out as a dot file
+        if ( opts.dump_ast ) {
+            report.begin("ast2dot");
+            dopass_ast2dot( tree );
+            report.end();
+        }
+        report.begin("typecheck");
+        dopass_typecheck(tree, &st, &ct, &at, diag, opts.symtab_dump, units);
+        report.end();
+        if ( opts.opt_level >= 1 ) {
+            report.begin("constantfolding");
+            dopass_constantfolding(tree, &at, opts.target, units);
+            report.end();
+        }
+
+        if ( opts.emit_asm ) {
+            report.begin("codegen");
+            dopass_codegen(tree, &st, &ct, &at, opts.mode, opts.target, opts.opt_level, out, NULL, units);
+            report.end();
+        } else {
+            Assembler object(opts.target);
+            report.begin("codegen");
+            dopass_codegen(tree, &st, &ct, &at, opts.mode, opts.target, opts.opt_level, out, &object, units);
+            report.end();
+            report.begin("object");
+            bool assembled = object.write(out);
+            report.end();
+            if ( !assembled ) {
+                fprintf(diag, "error: %s\n", object.error().c_str());
+                ok = false;
+            }
+        }
+    } catch ( CompileError & ) {
+        // the phase that found the errors is reported as far as it got
+        report.end();
+        ok = false;
+    }
+    delete units;
+    return ok;
+}
+
+// compiles one input to output_name; errors are printed to diag and the
+// time report to report_file (naming file, when there are several).
+// Everything the compilation builds (the tree, the symbol and class
+// tables, the output) belongs to this call, so several of them can run
+// on different threads.  With a cache, an input compiled before with the
+// same options is not compiled again.  false if the input had errors or
+// the output could not be written
+static bool compile(const Options & opts, SourceFile & input, const char* output_name, FILE* diag, FILE* report_file, const char* file = NULL) {
+    // every node built for this compilation comes out of this arena;
+    // it is released in one go when the compilation is done
+    Arena arena;
+    Arena::set_current(&arena);
+    TimeReport report(opts.time_report != NULL, &arena);
+
+    // the whole output is built in memory and written out in one go
+    OutputBuffer out;
+    std::string key;
+    bool cached = false;
+    if ( opts.cache ) {
+        report.begin("cache");
+        key = CompileCache::key(opts.cache_config, input.data(), input.size());
+        cached = opts.cache->fetch(key, &out);
+        report.end();
+        report.note("cache", cached ? "hit" : "miss");
+    }
+    bool ok = true;
+    if ( !cached ) {
+        ok = generate(opts, input, &out, diag, report);
+        if ( ok && opts.cache ) {
+            report.begin("cache store");
+            opts.cache->store(key, &out);
+            report.end();
+        }
+    }
+
+    if ( ok ) {
+        report.begin("output");
+        bool saved = out.save(output_name);
+        report.end();
+        if ( !saved ) {
+            fprintf(diag, "error: cannot write %s\n", output_name);
+            ok = false;
+        }
+    }
+
+    // a compilation that failed is reported too, as far as it got
+    if ( opts.time_report && strcmp(opts.time_report, "json") == 0 ) report.print_json(report_file, file);
+    else report.print_text(report_file, file);
+    return ok;
+}
+
+// adds the files a manifest lists, one name per line (blank lines are
+// skipped); false if it cannot be read
+static bool read_manifest(const char* name, std::vector<std::string> & inputs) {
+    FILE* f = fopen(name, "r");
+    if ( !f ) return false;
+    char line[4096];
+    while ( fgets(line, sizeof(line), f) ) {
+        size_t n = strlen(line);
+        while ( n > 0 && isspace((unsigned char)line[n-1]) ) n--;
+        if ( n > 0 ) inputs.push_back(std::string(line, n));
+    }
+    fclose(f);
+    return true;
+}
+
+// foo.lang -> foo.o (or foo.s)
+static std::string output_for(const std::string & input, bool emit_asm) {
+    std::string base = input;
+    size_t n = base.size();
+    if ( n > 5 && base.compare(n-5, 5, ".lang") == 0 ) base.erase(n-5);
+    return base + (emit_asm ? ".s" : ".o");
+}
+
+// one input of a multi-file run; its diagnostics and report are kept
+// until it is done, so those of different files do not interleave
+struct Job
+{
+    std::string input, output;
+    bool ok;
+};
+
+static std::mutex print_lock;
+
+static void run_job(const Options & opts, Job & job) {
+    char* diag_text = NULL;
+    size_t diag_size = 0;
+    char* report_text = NULL;
+    size_t report_size = 0;
+    FILE* diag = open_memstream(&diag_text, &diag_size);
+    FILE* report = open_memstream(&report_text, &report_size);
+
+    SourceFile input;
+    if ( input.open(job.input.c_str()) ) {
+        job.ok = compile(opts, input, job.output.c_str(), diag, report, job.input.c_str());
+    } else {
+        fprintf(diag, "error: cannot read %s\n", job.input.c_str());
+        job.ok = false;
+    }
+    fclose(diag);
+    fclose(report);
+
+    {
+        std::lock_guard<std::mutex> hold(print_lock);
+        // every line of a diagnostic is prefixed with the file it is about
+        for( char* line = diag_text; *line; ) {
+            char* eol = strchr(line, '\n');
+            size_t n = eol ? (size_t)(eol - line) + 1 : strlen(line);
+            fprintf(stderr, "%s: %.*s", job.input.c_str(), (int)n, line);
+            if ( !eol ) fputc('\n', stderr);
+            line += n;
+        }
+        // the report names its file itself
+        fwrite(report_text, 1, report_size, stderr);
+    }
+    free(diag_text);
+    free(report_text);
+}
+
+// compiles every input on a pool of threads; the number that failed
+static int compile_all(const Options & opts, const std::vector<std::string> & inputs, const char* output_name, int jobs) {
+    std::vector<Job> all(inputs.size());
+    std::vector<std::function<void()> > tasks;
+    for( size_t k=0; k<inputs.size(); k++ ) {
+        all[k].input = inputs[k];
+        all[k].output = output_name ? std::string(output_name) : output_for(inputs[k], opts.emit_asm);
+        Job* job = &all[k];
+        tasks.push_back([&opts, job]() { run_job(opts, *job); });
+    }
+    if ( jobs <= 0 ) jobs = std::thread::hardware_concurrency();
+    ThreadPool pool(jobs);
+    pool.run(tasks);
+
+    int failed = 0;
+    for( size_t k=0; k<all.size(); k++ ) if ( !all[k].ok ) failed++;
+    return failed;
+}
+
+int main(int argc, char** argv) {
+    // -O<n> sets the optimization level: 1 runs constant propagation and
+    // the peephole optimizer over the generated assembly, 2 also selects
+    // the register allocating code generator.  -fregalloc / -fno-regalloc
+    // pick the generator regardless of the level.  -m32 (the default) and
+    // -m64 pick the target; x86-64 code only comes from the register
+    // allocating generator.  The code is written as an ELF object, or with
+    // -S as assembly, to the file named by -o (test.o or test.s by
+    // default, - for stdout).  Diagnostics go to stderr.
+    //
+    // Without input files the program is read from stdin.  Given files
+    // (or @manifest, a file listing one input per line), each one is
+    // compiled to an object of its own name (foo.lang -> foo.o, or foo.s
+    // with -S), -j <n> of them at a time (one per CPU by default); -o
+    // only goes with a single input.
+    //
+    // Debugging: -fdump-ast prints the syntax tree as a dot graph to
+    // stdout, -fdump-symtab writes the symbol table to symboltable.txt,
+    // and -ftrace=<categories> turns on the trace points (see trace.hpp)
+    // of a compiler built with TRACE_LEVEL.  -ftime-report prints what
+    // each phase cost to stderr when the compilation is done
+    // (-ftime-report=json as JSON).
+    //
+    // -fcache=<dir> keeps the outputs in dir and reuses them when the same
+    // source is compiled again with the same options (see cache.hpp);
+    // -fcache-size=<n>[K|M|G] limits the space it takes (512M by default).
+    // With -fincremental (which goes with -fcache) every class is cached
+    // on its own as well, and when the input has changed only the classes
+    // that changed, and those that depend on them, are compiled again
+    // (see classunits.hpp).  With -ftime-report the report says whether
+    // each input was a hit (and how many classes were compiled), and ends
+    // with the totals of the cache.
+    Options opts;
+    opts.opt_level = 0;
+    opts.target = tg_i386;
+    opts.emit_asm = false;
+    opts.dump_ast = false;
+    opts.symtab_dump = NULL;
+    opts.time_report = NULL;
+    opts.cache = NULL;
+    opts.incremental = false;
+    const char* cache_dir = NULL;
+    unsigned long long cache_size = 512ULL << 20;
+    bool tracing = false;
+    int regalloc = -1;
+    const char* output_name = NULL;
+    int jobs = 0;
+    std::vector<std::string> inputs;
+    for( int i=1; i<argc; i++ ) {
+        if ( strcmp(argv[i], "-O") == 0 ) opts.opt_level = 1;
+        else if ( strncmp(argv[i], "-O", 2) == 0 && isdigit(argv[i][2]) ) opts.opt_level = atoi(argv[i]+2);
+        else if ( strcmp(argv[i], "-fregalloc") == 0 ) regalloc = 1;
+        else if ( strcmp(argv[i], "-fno-regalloc") == 0 ) regalloc = 0;
+        else if ( strcmp(argv[i], "-m32") == 0 ) opts.target = tg_i386;
+        else if ( strcmp(argv[i], "-m64") == 0 ) opts.target = tg_x86_64;
+        else if ( strcmp(argv[i], "-S") == 0 ) opts.emit_asm = true;
+        else if ( strcmp(argv[i], "-o") == 0 && i+1 < argc ) output_name = argv[++i];
+        else if ( strcmp(argv[i], "-j") == 0 && i+1 < argc && isdigit(argv[i+1][0]) ) jobs = atoi(argv[++i]);
+        else if ( strncmp(argv[i], "-j", 2) == 0 && isdigit(argv[i][2]) ) jobs = atoi(argv[i]+2);
+        else if ( strcmp(argv[i], "-fdump-ast") == 0 ) opts.dump_ast = true;
+        else if ( strcmp(argv[i], "-fdump-symtab") == 0 ) opts.symtab_dump = "symboltable.txt";
+        else if ( strcmp(argv[i], "-ftime-report") == 0 ) opts.time_report = "text";
+        else if ( strcmp(argv[i], "-ftime-report=text") == 0 || strcmp(argv[i], "-ftime-report=json") == 0 ) opts.time_report = argv[i]+14;
+        else if ( strncmp(argv[i], "-fcache=", 8) == 0 && argv[i][8] ) cache_dir = argv[i]+8;
+        else if ( strcmp(argv[i], "-fincremental") == 0 ) opts.incremental = true;
+        else if ( strncmp(argv[i], "-fcache-size=", 13) == 0 && isdigit(argv[i][13]) ) {
+            char* unit;
+            cache_size = strtoull(argv[i]+13, &unit, 10);
+            if ( *unit == 'K' ) cache_size <<= 10;
+            else if ( *unit == 'M' ) cache_size <<= 20;
+            else if ( *unit == 'G' ) cache_size <<= 30;
+        }
+        else if ( strncmp(argv[i], "-ftrace=", 8) == 0 && Trace::enable(argv[i]+8) ) {
+            tracing = true;
+            if ( TRACE_LEVEL == 0 ) fprintf(stderr, "warning: %s: no trace points built in (make TRACE_LEVEL=2)\n", argv[i]);
+        }
+        else if ( argv[i][0] == '@' && argv[i][1] ) {
+            if ( !read_manifest(argv[i]+1, inputs) ) {
+                fprintf(stderr, "error: cannot read %s\n", argv[i]+1);
+                return 1;
+            }
+        }
+        else if ( argv[i][0] != '-' ) inputs.push_back(argv[i]);
+        else {
+            fprintf(stderr, "usage: %s [-O<n>] [-fregalloc] [-m32|-m64] [-S] [-o file] [-j <n>] [-fdump-ast] [-fdump-symtab] [-ftrace=<categories>] [-ftime-report[=json]] [-fcache=<dir>] [-fcache-size=<n>] [-fincremental] [file.lang... | @manifest | < input.lang]\n", argv[0]);
+            return 1;
+        }
+    }
+    if ( opts.target == tg_x86_64 && regalloc == 0 ) {
+        fprintf(stderr, "error: -m64 needs the register allocating code generator\n");
+        return 1;
+    }
+    if ( opts.incremental && !cache_dir ) fprintf(stderr, "warning: -fincremental does nothing without -fcache\n");
+    if ( inputs.size() > 1 && (output_name || opts.dump_ast || opts.symtab_dump) ) {
+        fprintf(stderr, "error: -o, -fdump-ast and -fdump-symtab take a single input\n");
+        return 1;
+    }
     // set this to 1 if you would like to print a trace 
     // of the entire parsing process (it prints to stdout)
     yydebug = 0; 
-    
-    // after parsing, the global "ast" should be set to the
-    // syntax tree that we have built up during the parse
-    yyparse();  
-    
-    // walk over the ast and print it out as a dot file
-    dopass_ast2dot( ast );
-    dopass_typecheck(ast, &st, &ct); 
-    dopass_codegen(ast, &st, &ct); 
-    return 0;
-}
 
+    if ( regalloc < 0 ) regalloc = (opts.opt_level >= 2 || opts.target == tg_x86_64);
+    opts.mode = regalloc ? cg_regalloc : cg_stack;
+
+    // the cache is left out when the passes have to run for what they
+    // print along the way
+    char config[64];
+    snprintf(config, sizeof(config), "-O%d %d %d %d", opts.opt_level, (int)opts.mode, (int)opts.target, (int)opts.emit_asm);
+    opts.cache_config = config;
+    CompileCache* cache = NULL;
+    if ( cache_dir && !opts.dump_ast && !opts.symtab_dump && !(tracing && TRACE_LEVEL > 0) ) {
+        cache = new CompileCache(cache_dir, cache_size);
+        if ( cache->ready() ) opts.cache = cache;
+        else fprintf(stderr, "warning: cannot use %s as the cache\n", cache_dir);
+    }
+
+    int failed = 0;
+    if ( inputs.empty() ) {
+        if ( !output_name ) output_name = opts.emit_asm ? "test.s" : "test.o";
+        SourceFile input;
+        if ( !input.load(STDIN_FILENO) ) {
+            fprintf(stderr, "error: cannot read the input\n");
+            return 1;
+        }
+        if ( !compile(opts, input, output_name, stderr, stderr) ) failed++;
+    } else {
+        failed = compile_all(opts, inputs, output_name, jobs);
+    }
+
+    if ( opts.cache && opts.time_report ) {
+        if ( strcmp(opts.time_report, "json") == 0 ) opts.cache->print_json(stderr);
+        else opts.cache->print_text(stderr);
+    }
+    delete cache;
+    return failed ? 1 : 0;
+}
@@ -1,2 +1,7 @@
-echo "Making ./start from test.s"
-gcc -g -m32 -o start start.c test.s
+# usage: make_start.sh [-m32|-m64], matching the target test.o (or test.s,
+# from lang -S) was generated for
+ARCH=${1:--m32}
+SRC=test.o
+[ -f test.o ] || SRC=test.s
+echo "Making ./start from $SRC ($ARCH)"
+gcc -g $ARCH -o start start.c $SRC
@@ -0,0 +1,64 @@
+#include "output.hpp"
+#include <stdio.h>
+#include <string.h>
+
+/****** OutputBuffer Implementation **************************************/
+
+OutputBuffer::OutputBuffer(size_t initial)
+	: m_data(initial)
+{
+	m_size = 0;
+}
+
+//makes room for more bytes (growing by doubling, so appending stays
+//linear overall)
+void OutputBuffer::reserve(size_t more)
+{
+	if ( m_size + more <= m_data.size() ) return;
+	size_t n = m_data.size() ? m_data.size() : 1;
+	while ( n < m_size + more ) n *= 2;
+	m_data.resize(n);
+}
+
+void OutputBuffer::append(const char* s, size_t n)
+{
+	reserve(n);
+	memcpy(&m_data[m_size], s, n);
+	m_size += n;
+}
+
+void OutputBuffer::print(const char* fmt, ...)
+{
+	va_list ap;
+	va_start(ap, fmt);
+	vprint(fmt, ap);
+	va_end(ap);
+}
+
+//formats straight into the buffer; only a line that does not fit into
+//what is left is formatted twice
+void OutputBuffer::vprint(const char* fmt, va_list ap)
+{
+	va_list again;
+	va_copy(again, ap);
+	reserve(256);
+	size_t room = m_data.size() - m_size;
+	int n = vsnprintf(&m_data[m_size], room, fmt, ap);
+	if ( n >= 0 && (size_t)n >= room ) {
+		reserve(n+1);
+		vsnprintf(&m_data[m_size], n+1, fmt, again);
+	}
+	va_end(again);
+	if ( n > 0 ) m_size += n;
+}
+
+bool OutputBuffer::save(const char* name)
+{
+	bool to_stdout = (strcmp(name, "-") == 0);
+	FILE* f = to_stdout ? stdout : fopen(name, "wb");
+	if ( !f ) return false;
+	bool ok = (m_size == 0 || fwrite(&m_data[0], 1, m_size, f) == m_size);
+	if ( to_stdout ) ok = (fflush(f) == 0) && ok;
+	else ok = (fclose(f) == 0) && ok;
+	return ok;
+}
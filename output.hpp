@@ -0,0 +1,36 @@
+#ifndef OUTPUT_HPP
+#define OUTPUT_HPP
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <vector>
+
+// Where the compiler's output (the assembly, or the object file) is
+// collected.  Everything is appended to one growing block of memory and
+// written to its file with a single write at the end, so emitting an
+// instruction never costs a system call.  Diagnostics do not go through
+// here; they stay on stderr.
+class OutputBuffer
+{
+  std::vector<char> m_data;
+  size_t m_size;             // bytes of m_data in use
+
+  void reserve(size_t more);
+
+  public:
+
+  OutputBuffer(size_t initial = 1 << 20);
+
+  void append(const char* s, size_t n);
+  void print(const char* fmt, ...);
+  void vprint(const char* fmt, va_list ap);
+
+  const char* data() { return m_data.empty() ? NULL : &m_data[0]; }
+  size_t size() { return m_size; }
+
+  //writes everything to the file called name ("-" is stdout); false if
+  //that did not work
+  bool save(const char* name);
+};
+
+#endif //OUTPUT_HPP
@@ -0,0 +1,38 @@
+#ifndef PARSECONTEXT_HPP
+#define PARSECONTEXT_HPP
+
+#include <stdio.h>
+
+class Program;
+
+// Everything one parse works with: the scanner, the line it is on, the
+// count of nodes built so far and, at the end, the tree.  The scanner
+// and the parser are reentrant and keep no state of their own, so any
+// number of parses can run at once, each with its own context (and on
+// its own thread, because the tree goes into the thread's arena).
+//
+// The node constructors find the context through current(), which is
+// set while parse() runs.
+class ParseContext
+{
+  public:
+
+  void* scanner;     // the flex scanner (a yyscan_t)
+  Program* ast;      // the tree, once the parse is done
+  int node_count;    // nodes built so far; node indices run from 0 to node_count-1
+  int lineno;        // the line of the last token read
+  FILE* errfile;     // where syntax errors are reported
+
+  ParseContext(FILE* errfile);
+
+  //parses the size bytes of text and returns the tree; a syntax error
+  //is printed to errfile and throws CompileError.  The text must be
+  //followed by two zero bytes and be writable: the scanner works on it
+  //in place (see SourceFile)
+  Program* parse(char* text, size_t size);
+
+  //the context of the parse running on this thread
+  static ParseContext* current();
+};
+
+#endif //PARSECONTEXT_HPP
@@ -0,0 +1,557 @@
+#include "peephole.hpp"
+#include "assembler.hpp"
+#include <stdarg.h>
+#include <string.h>
+#include <ctype.h>
+#include <assert.h>
+
+/****** AsmInst Implementation **************************************/
+
+static std::string trim(const std::string & s)
+{
+	size_t b = s.find_first_not_of(" \t");
+	if ( b == std::string::npos ) return "";
+	size_t e = s.find_last_not_of(" \t");
+	return s.substr(b, e-b+1);
+}
+
+AsmInst AsmInst::parse(const std::string & line)
+{
+	AsmInst r;
+	r.text = line;
+	r.nargs = 0;
+	r.changed = false;
+
+	std::string t = trim(line);
+	if ( !t.empty() && t[t.size()-1] == ':' && t.find_first_of(" \t") == std::string::npos ) {
+		r.kind = label;
+		r.op = t.substr(0, t.size()-1);
+		return r;
+	}
+	if ( t.empty() || t[0] == '#' || t[0] == '.' ) {
+		r.kind = other;
+		return r;
+	}
+
+	r.kind = insn;
+	size_t sp = t.find_first_of(" \t");
+	r.op = t.substr(0, sp);
+	if ( sp == std::string::npos ) return r;
+
+	//split the operands at the commas that are not inside parentheses
+	std::string rest = trim(t.substr(sp));
+	int depth = 0;
+	size_t start = 0;
+	for( size_t k=0; k<=rest.size() && r.nargs<2; k++ ) {
+		if ( k == rest.size() || (rest[k] == ',' && depth == 0) ) {
+			r.arg[r.nargs++] = trim(rest.substr(start, k-start));
+			start = k+1;
+		} else if ( rest[k] == '(' ) {
+			depth++;
+		} else if ( rest[k] == ')' ) {
+			depth--;
+		}
+	}
+	return r;
+}
+
+void AsmInst::rewrite(const std::string & new_op, int n, std::string a0, std::string a1)
+{
+	kind = insn;
+	op = new_op;
+	nargs = n;
+	arg[0] = a0;
+	arg[1] = a1;
+	changed = true;
+}
+
+void AsmInst::remove()
+{
+	kind = other;
+	text = "";
+	changed = true;
+}
+
+void AsmInst::print(OutputBuffer* out)
+{
+	if ( !changed ) {
+		out->append(text.data(), text.size());
+		out->append("\n", 1);
+	} else if ( kind == insn ) {
+		out->print("        %s", op.c_str());
+		for( int k=0; k<nargs; k++ ) {
+			out->print("%s%s", (k == 0) ? " " : ", ", arg[k].c_str());
+		}
+		out->append("\n", 1);
+	}
+	//a removed line prints nothing
+}
+
+/****** AsmBuffer Implementation **************************************/
+
+AsmBuffer::AsmBuffer(OutputBuffer* out, bool optimize, Assembler* object)
+{
+	m_out = out;
+	m_optimize = optimize;
+	m_object = object;
+	m_saved_out = NULL;
+	m_saved_object = NULL;
+}
+
+AsmBuffer::~AsmBuffer()
+{
+	flush();
+}
+
+void AsmBuffer::emit(const char* fmt, ...)
+{
+	va_list ap;
+	va_start(ap, fmt);
+	if ( !buffered() ) {
+		m_out->vprint(fmt, ap);
+		va_end(ap);
+		return;
+	}
+
+	char buf[256];
+	va_list ap2;
+	va_copy(ap2, ap);
+	int n = vsnprintf(buf, sizeof(buf), fmt, ap);
+	if ( n < (int)sizeof(buf) ) {
+		m_partial += buf;
+	} else {
+		std::vector<char> big(n+1);
+		vsnprintf(&big[0], n+1, fmt, ap2);
+		m_partial += &big[0];
+	}
+	va_end(ap2);
+	va_end(ap);
+
+	size_t nl;
+	while ( (nl = m_partial.find('\n')) != std::string::npos ) {
+		m_code.push_back(AsmInst::parse(m_partial.substr(0, nl)));
+		m_partial.erase(0, nl+1);
+	}
+}
+
+void AsmBuffer::flush()
+{
+	if ( !buffered() ) return;
+	if ( !m_partial.empty() ) {
+		m_code.push_back(AsmInst::parse(m_partial));
+		m_partial.clear();
+	}
+	if ( m_optimize ) Peephole::run(m_code);
+	for( size_t k=0; k<m_code.size(); k++ ) {
+		if ( m_object ) m_object->assemble(m_code[k]);
+		else m_code[k].print(m_out);
+	}
+	m_code.clear();
+}
+
+void AsmBuffer::capture(OutputBuffer* unit)
+{
+	assert(m_saved_out == NULL);
+	flush();
+	m_saved_out = m_out;
+	m_saved_object = m_object;
+	m_out = unit;
+	m_object = NULL;
+}
+
+void AsmBuffer::release()
+{
+	assert(m_saved_out != NULL);
+	flush();
+	m_out = m_saved_out;
+	m_object = m_saved_object;
+	m_saved_out = NULL;
+	m_saved_object = NULL;
+}
+
+void AsmBuffer::replay(const char* text, size_t n)
+{
+	flush();
+	if ( !m_object ) {
+		m_out->append(text, n);
+		return;
+	}
+	const char* end = text + n;
+	while ( text < end ) {
+		const char* nl = (const char*)memchr(text, '\n', end - text);
+		if ( !nl ) nl = end;
+		m_object->assemble(AsmInst::parse(std::string(text, nl - text)));
+		text = nl + 1;
+	}
+}
+
+/****** Peephole Implementation **************************************/
+
+// registers as bits: eax ecx edx ebx esp ebp esi edi
+enum { EAX = 1, ECX = 2, EDX = 4, EBX = 8, ESP = 16, EBP = 32, ESI = 64, EDI = 128 };
+static const unsigned all_regs = 0xff;
+
+//the register a name (with or without the %) refers to, counting the
+//8 and 16 bit parts as the whole register
+static unsigned reg_bit(const char* s)
+{
+	static const char* names[8][4] = {
+		{ "eax", "ax", "al", "ah" }, { "ecx", "cx", "cl", "ch" },
+		{ "edx", "dx", "dl", "dh" }, { "ebx", "bx", "bl", "bh" },
+		{ "esp", "sp", NULL, NULL }, { "ebp", "bp", NULL, NULL },
+		{ "esi", "si", NULL, NULL }, { "edi", "di", NULL, NULL } };
+	for( int r=0; r<8; r++ ) {
+		for( int k=0; k<4; k++ ) {
+			if ( names[r][k] && strcmp(s, names[r][k]) == 0 ) return 1u << r;
+		}
+	}
+	return 0;
+}
+
+static bool is_reg(const std::string & s) { return !s.empty() && s[0] == '%'; }
+static bool is_imm(const std::string & s) { return !s.empty() && s[0] == '$'; }
+static bool is_mem(const std::string & s) { return !s.empty() && !is_reg(s) && !is_imm(s); }
+
+//every register an operand mentions, directly or in its address
+static unsigned regs_in(const std::string & s)
+{
+	unsigned r = 0;
+	for( size_t k=0; k<s.size(); k++ ) {
+		if ( s[k] != '%' ) continue;
+		size_t e = k+1;
+		while ( e < s.size() && isalpha((unsigned char)s[e]) ) e++;
+		r |= reg_bit(s.substr(k+1, e-k-1).c_str());
+		k = e-1;
+	}
+	return r;
+}
+
+//the register an operand names (0 when it is not a register)
+static unsigned reg_of(const std::string & s)
+{
+	return is_reg(s) ? regs_in(s) : 0;
+}
+
+//registers an operand needs when it is read
+static unsigned read_regs(const std::string & s) { return regs_in(s); }
+
+//registers an operand needs when it is only written (its address)
+static unsigned addr_regs(const std::string & s) { return is_mem(s) ? regs_in(s) : 0; }
+
+//true for an address relative to the frame pointer; those can only be
+//changed through the same address, never by a callee or a heap store
+static bool frame_slot(const std::string & s)
+{
+	return is_mem(s) && regs_in(s) == EBP && s.find("(%ebp)") != std::string::npos;
+}
+
+static bool may_alias(const std::string & a, const std::string & b)
+{
+	if ( frame_slot(a) && frame_slot(b) ) return a == b;
+	if ( frame_slot(a) || frame_slot(b) ) return false;
+	return true;
+}
+
+static bool transparent(const AsmInst & i)
+{
+	if ( i.kind != AsmInst::other ) return false;
+	std::string t = trim(i.text);
+	return t.empty() || t[0] == '#';
+}
+
+struct Effects
+{
+	unsigned reads;
+	unsigned writes;
+	std::string store;   // memory operand written, if any
+	bool clobbers_heap;  // a call: any memory but the frame may change
+	bool control;        // a label, jump, return or something unknown
+};
+
+static bool starts_with(const std::string & s, const char* p)
+{
+	return s.compare(0, strlen(p), p) == 0;
+}
+
+static Effects effects(const AsmInst & i)
+{
+	Effects e;
+	e.reads = e.writes = 0;
+	e.clobbers_heap = false;
+	e.control = false;
+
+	if ( i.kind != AsmInst::insn ) {
+		e.control = !transparent(i);
+		return e;
+	}
+
+	const std::string & op = i.op;
+	const std::string & a0 = i.arg[0];
+	const std::string & a1 = i.arg[1];
+
+	if ( i.nargs == 2 && (op == "movl" || op == "movzbl" || op == "leal") ) {
+		e.reads = ((op == "leal") ? addr_regs(a0) : read_regs(a0)) | addr_regs(a1);
+		e.writes = reg_of(a1);
+		if ( is_mem(a1) ) e.store = a1;
+	} else if ( i.nargs == 2 && (op == "addl" || op == "subl" || op == "andl" || op == "orl" ||
+	                             op == "xorl" || op == "imull") ) {
+		e.reads = read_regs(a0) | read_regs(a1);
+		e.writes = reg_of(a1);
+		if ( is_mem(a1) ) e.store = a1;
+	} else if ( i.nargs == 2 && (op == "cmpl" || op == "testl") ) {
+		e.reads = read_regs(a0) | read_regs(a1);
+	} else if ( i.nargs == 1 && (op == "negl" || op == "notl" || op == "incl" || op == "decl" ||
+	                             starts_with(op, "set")) ) {
+		//(a setcc only writes the low byte, so it reads the rest)
+		e.reads = read_regs(a0);
+		e.writes = reg_of(a0);
+		if ( is_mem(a0) ) e.store = a0;
+	} else if ( i.nargs == 1 && op == "pushl" ) {
+		e.reads = read_regs(a0) | ESP;
+		e.writes = ESP;
+	} else if ( i.nargs == 1 && op == "popl" ) {
+		e.reads = addr_regs(a0) | ESP;
+		e.writes = reg_of(a0) | ESP;
+		if ( is_mem(a0) ) e.store = a0;
+	} else if ( i.nargs == 0 && (op == "cdq" || op == "cltd") ) {
+		e.reads = EAX;
+		e.writes = EDX;
+	} else if ( i.nargs == 1 && op == "idivl" ) {
+		e.reads = read_regs(a0) | EAX | EDX;
+		e.writes = EAX | EDX;
+	} else if ( op == "call" ) {
+		//every method saves %ebx (and IrEmitter %esi and %edi) for its caller
+		e.reads = ESP;
+		e.writes = EAX | ECX | EDX | ESP;
+		e.clobbers_heap = true;
+	} else if ( op == "leave" ) {
+		e.reads = EBP;
+		e.writes = ESP | EBP;
+	} else if ( op == "ret" ) {
+		//the value goes back to the caller, and so do the registers a
+		//method keeps for it (%ebx in Codegen's prologue, the callee
+		//saved ones it uses in IrEmitter's)
+		e.reads = EAX | EBX | ESI | EDI | EBP | ESP;
+		e.control = true;
+	} else {
+		//jumps, and anything this table does not know about
+		e.reads = all_regs;
+		e.writes = all_regs;
+		e.control = true;
+	}
+	return e;
+}
+
+static int next(std::vector<AsmInst> & code, int i)
+{
+	for( i++; i<(int)code.size(); i++ ) {
+		if ( !transparent(code[i]) ) return i;
+	}
+	return -1;
+}
+
+static int prev(std::vector<AsmInst> & code, int i)
+{
+	for( i--; i>=0; i-- ) {
+		if ( !transparent(code[i]) ) return i;
+	}
+	return -1;
+}
+
+//true if the value in the registers r is never read after instruction i
+static bool dead_after(std::vector<AsmInst> & code, int i, unsigned r)
+{
+	for( int k=next(code, i); k>=0; k=next(code, k) ) {
+		Effects e = effects(code[k]);
+		if ( e.reads & r ) return false;
+		if ( e.control ) return code[k].op == "ret";
+		if ( (e.writes & r) == r ) return true;
+	}
+	return false;
+}
+
+static bool two_memory(const std::string & a, const std::string & b)
+{
+	return is_mem(a) && is_mem(b);
+}
+
+// pushl X ... popl %R  ==>  ... movl X, %R
+// (or nothing at all when X is %R), provided the instructions in between
+// leave the stack, %R and everything X depends on alone
+static bool rule_push_pop(std::vector<AsmInst> & code, int j)
+{
+	AsmInst & pop = code[j];
+	if ( pop.kind != AsmInst::insn || pop.op != "popl" || !is_reg(pop.arg[0]) ) return false;
+	unsigned y = reg_of(pop.arg[0]);
+
+	//find the push, over instructions that do not touch the stack or %R
+	int k;
+	for( k=prev(code, j); k>=0; k=prev(code, k) ) {
+		if ( code[k].kind == AsmInst::insn && code[k].op == "pushl" ) break;
+		Effects e = effects(code[k]);
+		if ( e.control || e.clobbers_heap ) return false;
+		if ( (e.reads | e.writes) & (ESP | y) ) return false;
+	}
+	if ( k < 0 ) return false;
+
+	//the push's operand is now read at the pop, so nothing it depends
+	//on may change in between
+	std::string x = code[k].arg[0];
+	if ( regs_in(x) & ESP ) return false;
+	for( int i=next(code, k); i!=j; i=next(code, i) ) {
+		Effects e = effects(code[i]);
+		if ( e.writes & regs_in(x) ) return false;
+		if ( !e.store.empty() && is_mem(x) && may_alias(e.store, x) ) return false;
+	}
+
+	code[k].remove();
+	if ( x == pop.arg[0] ) pop.remove();
+	else pop.rewrite("movl", 2, x, pop.arg[0]);
+	return true;
+}
+
+// movl A, %R ; op %R, B  ==>  op A, B   when %R is dead afterwards
+// (this is what folds immediates and memory operands into ALU ops)
+static bool rule_forward(std::vector<AsmInst> & code, int i)
+{
+	AsmInst & mov = code[i];
+	if ( mov.kind != AsmInst::insn || mov.op != "movl" || mov.nargs != 2 || !is_reg(mov.arg[1]) ) return false;
+	const std::string & a = mov.arg[0];
+	unsigned r = reg_of(mov.arg[1]);
+	if ( r & (ESP | EBP) ) return false;
+
+	int j = next(code, i);
+	if ( j < 0 ) return false;
+	AsmInst & use = code[j];
+	if ( use.kind != AsmInst::insn ) return false;
+
+	//%R has to be one whole operand of use and appear nowhere else
+	int p = -1;
+	for( int k=0; k<use.nargs; k++ ) {
+		if ( use.arg[k] == mov.arg[1] ) {
+			if ( p >= 0 ) return false;
+			p = k;
+		} else if ( regs_in(use.arg[k]) & r ) {
+			return false;
+		}
+	}
+	if ( p < 0 ) return false;
+
+	const std::string & op = use.op;
+	if ( p == 0 && use.nargs == 2 && (op == "movl" || op == "addl" || op == "subl" || op == "andl" ||
+	                                  op == "orl" || op == "xorl" || op == "imull" || op == "cmpl") ) {
+		if ( two_memory(a, use.arg[1]) ) return false;
+		if ( op == "imull" && !is_reg(use.arg[1]) ) return false;
+	} else if ( p == 1 && use.nargs == 2 && op == "cmpl" ) {
+		if ( is_imm(a) || two_memory(use.arg[0], a) ) return false;
+	} else if ( p == 0 && use.nargs == 1 && op == "pushl" ) {
+	} else if ( p == 0 && use.nargs == 1 && op == "idivl" ) {
+		if ( is_imm(a) ) return false;
+	} else {
+		return false;
+	}
+
+	if ( !dead_after(code, j, r) ) return false;
+	use.arg[p] = a;
+	use.changed = true;
+	mov.remove();
+	return true;
+}
+
+// movl M, %R ... movl M, %R  ==>  the second one goes, if neither %R nor
+// M changed in between (also after movl %R, M)
+static bool rule_reload(std::vector<AsmInst> & code, int j)
+{
+	AsmInst & load = code[j];
+	if ( load.kind != AsmInst::insn || load.op != "movl" || load.nargs != 2 ) return false;
+	const std::string & m = load.arg[0];
+	if ( !is_mem(m) || !is_reg(load.arg[1]) ) return false;
+	unsigned r = reg_of(load.arg[1]);
+	if ( regs_in(m) & r ) return false;
+
+	for( int i=prev(code, j); i>=0; i=prev(code, i) ) {
+		AsmInst & d = code[i];
+		if ( d.kind == AsmInst::insn && d.op == "movl" && d.nargs == 2 &&
+		     ((d.arg[0] == m && d.arg[1] == load.arg[1]) || (d.arg[0] == load.arg[1] && d.arg[1] == m)) ) {
+			load.remove();
+			return true;
+		}
+		Effects e = effects(d);
+		if ( e.control ) return false;
+		if ( e.writes & (r | regs_in(m)) ) return false;
+		if ( !e.store.empty() && may_alias(e.store, m) ) return false;
+		if ( e.clobbers_heap && !frame_slot(m) ) return false;
+	}
+	return false;
+}
+
+// movl %R, %R  ==>  nothing
+static bool rule_self_move(std::vector<AsmInst> & code, int i)
+{
+	AsmInst & mov = code[i];
+	if ( mov.kind != AsmInst::insn || mov.op != "movl" || mov.nargs != 2 ) return false;
+	if ( !is_reg(mov.arg[0]) || mov.arg[0] != mov.arg[1] ) return false;
+	mov.remove();
+	return true;
+}
+
+// movl X, %R  ==>  nothing, when %R is never read again
+static bool rule_dead_move(std::vector<AsmInst> & code, int i)
+{
+	AsmInst & mov = code[i];
+	if ( mov.kind != AsmInst::insn || mov.op != "movl" || mov.nargs != 2 || !is_reg(mov.arg[1]) ) return false;
+	unsigned r = reg_of(mov.arg[1]);
+	if ( r & (ESP | EBP) ) return false;
+	if ( !dead_after(code, i, r) ) return false;
+	mov.remove();
+	return true;
+}
+
+// jmp L ; L:  ==>  L:
+static bool rule_jump_to_next(std::vector<AsmInst> & code, int i)
+{
+	AsmInst & jmp = code[i];
+	if ( jmp.kind != AsmInst::insn || jmp.op != "jmp" || jmp.nargs != 1 ) return false;
+	int j = next(code, i);
+	if ( j < 0 || code[j].kind != AsmInst::label || code[j].op != jmp.arg[0] ) return false;
+	jmp.remove();
+	return true;
+}
+
+// addl $N, %esp ; leave  ==>  leave
+static bool rule_pop_before_leave(std::vector<AsmInst> & code, int i)
+{
+	AsmInst & add = code[i];
+	if ( add.kind != AsmInst::insn || add.op != "addl" || add.nargs != 2 ) return false;
+	if ( !is_imm(add.arg[0]) || add.arg[1] != "%esp" ) return false;
+	int j = next(code, i);
+	if ( j < 0 || code[j].kind != AsmInst::insn || code[j].op != "leave" ) return false;
+	add.remove();
+	return true;
+}
+
+typedef bool (*PeepholeRule)(std::vector<AsmInst> & code, int i);
+
+static const PeepholeRule rules[] = {
+	rule_push_pop,
+	rule_forward,
+	rule_reload,
+	rule_self_move,
+	rule_dead_move,
+	rule_jump_to_next,
+	rule_pop_before_leave,
+};
+
+void Peephole::run(std::vector<AsmInst> & code)
+{
+	bool changed = true;
+	while ( changed ) {
+		changed = false;
+		for( int i=0; i<(int)code.size(); i++ ) {
+			for( size_t k=0; k<sizeof(rules)/sizeof(rules[0]); k++ ) {
+				if ( transparent(code[i]) ) break;
+				if ( rules[k](code, i) ) changed = true;
+			}
+		}
+	}
+}
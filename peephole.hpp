@@ -0,0 +1,76 @@
+#ifndef PEEPHOLE_HPP
+#define PEEPHOLE_HPP
+
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include "output.hpp"
+
+class Assembler;
+
+// One line of the assembly the code generators write.  Instructions are
+// split into mnemonic and (AT&T ordered) operands so the peephole rules
+// can look at them; everything else is carried through as text.
+struct AsmInst
+{
+  enum Kind { insn, label, other };
+
+  Kind kind;
+  std::string text;   // the line as it was emitted (without the newline)
+  std::string op;     // mnemonic, or the name of a label
+  std::string arg[2];
+  int nargs;
+  bool changed;       // text is stale, print op and arg instead
+
+  static AsmInst parse(const std::string & line);
+  //(the operands are taken by value, they may be this instruction's own)
+  void rewrite(const std::string & new_op, int n, std::string a0 = "", std::string a1 = "");
+  void remove();
+  void print(OutputBuffer* out);
+};
+
+// Where the code generators send their assembly.  Without optimization
+// every emit() goes straight to the output.  With it, lines are
+// collected until flush() (called at the end of every method), run
+// through the peephole rules, and then written in one go.  When an
+// Assembler is given the lines are handed to it at flush() instead of
+// being printed.
+class AsmBuffer
+{
+  OutputBuffer* m_out;
+  bool m_optimize;
+  Assembler* m_object;
+  std::string m_partial;        // text of a line that has not ended yet
+  std::vector<AsmInst> m_code;
+  OutputBuffer* m_saved_out;    // while capturing: where things went before
+  Assembler* m_saved_object;
+
+  bool buffered() { return m_optimize || m_object != NULL; }
+
+  public:
+
+  AsmBuffer(OutputBuffer* out, bool optimize, Assembler* object = NULL);
+  ~AsmBuffer();
+
+  void emit(const char* fmt, ...);
+  void flush();
+
+  //capture() sends everything emitted from now on (optimized as usual)
+  //to unit as text, until release() sends things back where they went
+  //before.  replay() takes such text and passes it on as if it had just
+  //been emitted and flushed: the lines go to the assembler or the output,
+  //without being optimized again.
+  void capture(OutputBuffer* unit);
+  void release();
+  void replay(const char* text, size_t n);
+};
+
+// The peephole optimizer proper: a table of local rewrite rules that are
+// applied over the buffered instructions until none of them fires.
+class Peephole
+{
+  public:
+  static void run(std::vector<AsmInst> & code);
+};
+
+#endif //PEEPHOLE_HPP
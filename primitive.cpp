@@ -4,13 +4,11 @@
 Primitive::Primitive(int x)
 {
 	m_data = x;
-	m_parent_attribute = NULL;
 }
 
 Primitive::Primitive(const Primitive & other)
 {
 	m_data = other.m_data;
-	m_parent_attribute = other.m_parent_attribute;
 }
 
 Primitive& Primitive::operator=(const Primitive & other)
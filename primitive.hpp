@@ -8,7 +8,6 @@ class Primitive
 {
   public:
 	int m_data;
-	Attribute* m_parent_attribute;
 
   Primitive(const Primitive &);
 
@@ -17,6 +16,9 @@ class Primitive
   ~Primitive();
   virtual void accept(Visitor *v);
   virtual Primitive *clone() const;
+  // allocated in the current arena, like the generated nodes
+  static void* operator new(size_t size) { return Arena::current()->allocate(size); }
+  static void operator delete(void*) {}
   void swap(Primitive &);
 };
 
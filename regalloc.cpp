@@ -0,0 +1,523 @@
+#include "regalloc.hpp"
+#include <assert.h>
+#include <limits.h>
+#include <string.h>
+
+static const char* reg_name_32[num_machine_regs] =
+	{ "%eax", "%ecx", "%edx", "%ebx", "%esi", "%edi" };
+static const char* reg_name_64[num_machine_regs] =
+	{ "%rax", "%r10", "%r11", "%rbx", "%r12", "%r13" };
+
+// on i386 only the first four have an addressable low byte (needed by setcc)
+static const char* byte_name_32[num_machine_regs] =
+	{ "%al", "%cl", "%dl", "%bl", NULL, NULL };
+static const char* byte_name_64[num_machine_regs] =
+	{ "%al", "%r10b", "%r11b", "%bl", "%r12b", "%r13b" };
+
+static const char* sysv_arg_reg[sysv_reg_args] =
+	{ "%rdi", "%rsi", "%rdx", "%rcx", "%r8", "%r9" };
+
+static const unsigned all_regs = (1u << num_machine_regs) - 1;
+static const unsigned caller_saved = (1u << r_eax) | (1u << r_ecx) | (1u << r_edx);
+
+// the MachineRegs among the n physical registers named
+static unsigned regs_named(const char* const* reg_name, const char* const* names, int n)
+{
+	unsigned mask = 0;
+	for( int r=0; r<num_machine_regs; r++ ) {
+		for( int k=0; k<n; k++ ) {
+			if ( strcmp(reg_name[r], names[k]) == 0 ) mask |= 1u << r;
+		}
+	}
+	return mask;
+}
+
+// idiv takes its dividend in, and leaves the quotient and the remainder
+// in, these two; on x86-64 %rdx is not one of the MachineRegs
+static const char* divide_name_32[2] = { "%eax", "%edx" };
+static const char* divide_name_64[2] = { "%rax", "%rdx" };
+static const unsigned divide_regs_32 = regs_named(reg_name_32, divide_name_32, 2);
+static const unsigned divide_regs_64 = regs_named(reg_name_64, divide_name_64, 2);
+
+/****** LinearScan Implementation **************************************/
+
+LinearScan::LinearScan(IrFunction* f, Target target)
+{
+	m_f = f;
+	m_target = target;
+	m_slots = 0;
+	m_used = 0;
+}
+
+unsigned LinearScan::clobbers(IrOp op, Target target)
+{
+	switch( op ) {
+		case ir_call:
+		case ir_print: return caller_saved;
+		case ir_div: return (target == tg_x86_64) ? divide_regs_64 : divide_regs_32;
+		default: return 0;
+	}
+}
+
+void LinearScan::run()
+{
+	int n = m_f->m_vreg_count;
+	std::vector<IrInst> & code = m_f->m_code;
+
+	//the interval of every virtual register; virtual registers are
+	//numbered in the order they are defined, so the list is already
+	//sorted by start
+	std::vector<Interval> iv(n);
+	for( int pos=0; pos<(int)code.size(); pos++ ) {
+		IrInst & i = code[pos];
+		if ( i.op == ir_move ) {
+			//assigns again, the interval just goes on
+			iv[i.dst].end = pos;
+		} else if ( i.dst != no_vreg ) {
+			iv[i.dst].v = i.dst;
+			iv[i.dst].start = iv[i.dst].end = pos;
+		}
+		if ( i.a != no_vreg ) iv[i.a].end = pos;
+		if ( i.b != no_vreg ) iv[i.b].end = pos;
+	}
+	for( int v=0; v<n; v++ ) {
+		iv[v].forbidden = 0;
+		for( int pos=iv[v].start+1; pos<iv[v].end; pos++ ) {
+			iv[v].forbidden |= clobbers(code[pos].op, m_target);
+		}
+	}
+
+	m_reg.assign(n, -1);
+	m_slot.assign(n, -1);
+
+	std::vector<VReg> active; // intervals currently holding a register
+	unsigned free = all_regs;
+
+	for( int v=0; v<n; v++ ) {
+		Interval & cur = iv[v];
+
+		//registers of intervals that ended by now can be reused; one
+		//that ends where cur starts is an operand of cur's definition
+		for( size_t k=0; k<active.size(); ) {
+			if ( iv[active[k]].end <= cur.start ) {
+				free |= 1u << m_reg[active[k]];
+				active[k] = active.back();
+				active.pop_back();
+			} else {
+				k++;
+			}
+		}
+
+		unsigned allowed = all_regs & ~cur.forbidden;
+		unsigned candidates = free & allowed;
+		int r = -1;
+		if ( candidates != 0 ) {
+			//the result of a call or a divide arrives in %eax
+			IrOp op = code[cur.start].op;
+			if ( (op == ir_call || op == ir_div) && (candidates & (1u << r_eax)) ) {
+				r = r_eax;
+			} else {
+				for( r=0; !(candidates & (1u << r)); r++ ) ;
+			}
+		} else {
+			//no register left: spill whichever interval (cur or one of
+			//the active ones it could take the register of) ends last
+			int victim = -1;
+			for( size_t k=0; k<active.size(); k++ ) {
+				if ( (allowed & (1u << m_reg[active[k]])) &&
+				     (victim < 0 || iv[active[k]].end > iv[active[victim]].end) ) {
+					victim = k;
+				}
+			}
+			if ( victim >= 0 && iv[active[victim]].end > cur.end ) {
+				VReg spilled = active[victim];
+				r = m_reg[spilled];
+				m_reg[spilled] = -1;
+				m_slot[spilled] = m_slots++;
+				active[victim] = active.back();
+				active.pop_back();
+				free |= 1u << r;
+			} else {
+				m_slot[v] = m_slots++;
+				continue;
+			}
+		}
+
+		m_reg[v] = r;
+		m_used |= 1u << r;
+		free &= ~(1u << r);
+		active.push_back(v);
+	}
+
+	m_busy.assign(code.size(), 0);
+	for( int v=0; v<n; v++ ) {
+		if ( m_reg[v] < 0 ) continue;
+		for( int pos=iv[v].start; pos<=iv[v].end; pos++ ) {
+			m_busy[pos] |= 1u << m_reg[v];
+		}
+	}
+}
+
+/****** IrEmitter Implementation **************************************/
+
+IrEmitter::IrEmitter(AsmBuffer* out, IrFunction* f, LinearScan* ra, Target target, int locals_size, int reg_args)
+{
+	m_out = out;
+	m_f = f;
+	m_ra = ra;
+	m_target = target;
+	if ( target == tg_x86_64 ) {
+		m_word = 8;
+		m_sfx = 'q';
+		m_reg = reg_name_64;
+		m_byte = byte_name_64;
+		m_bp = "%rbp";
+		m_sp = "%rsp";
+	} else {
+		m_word = 4;
+		m_sfx = 'l';
+		m_reg = reg_name_32;
+		m_byte = byte_name_32;
+		m_bp = "%ebp";
+		m_sp = "%esp";
+	}
+	m_locals = locals_size;
+	m_reg_args = reg_args;
+	m_taken = 0;
+
+	//the callee saved registers the allocator used get a save slot
+	//each, below the spill slots
+	int offset = -(m_locals + m_ra->spill_slots()*m_word);
+	for( int r=0; r<num_machine_regs; r++ ) {
+		m_save_offset[r] = 0;
+		if ( (caller_saved & (1u << r)) == 0 && m_ra->used(r) ) {
+			offset -= m_word;
+			m_save_offset[r] = offset;
+		}
+	}
+}
+
+int IrEmitter::frame_size()
+{
+	int size = m_locals + m_ra->spill_slots()*m_word;
+	for( int r=0; r<num_machine_regs; r++ ) {
+		if ( m_save_offset[r] != 0 ) size += m_word;
+	}
+	//SysV wants %rsp 16 byte aligned at every call
+	if ( m_target == tg_x86_64 ) size = (size + 15) & ~15;
+	return size;
+}
+
+std::string IrEmitter::operand(VReg v)
+{
+	if ( in_reg(v) ) return m_reg[m_ra->reg(v)];
+	char buf[32];
+	snprintf(buf, sizeof(buf), "%d(%s)", -(m_locals + (m_ra->slot(v)+1)*m_word), m_bp);
+	return buf;
+}
+
+int IrEmitter::scratch(int pos, unsigned allowed)
+{
+	//a register nothing live is kept in...
+	unsigned idle = allowed & ~(m_ra->busy(pos) | m_taken);
+	for( int r=0; r<num_machine_regs; r++ ) {
+		if ( idle & (1u << r) ) {
+			m_taken |= 1u << r;
+			return r;
+		}
+	}
+	//...or else one borrowed for the length of the instruction
+	for( int r=0; r<num_machine_regs; r++ ) {
+		if ( (allowed & ~m_taken) & (1u << r) ) {
+			m_out->emit("        push%c %s\n", m_sfx, m_reg[r]);
+			m_saved.push_back(r);
+			m_taken |= 1u << r;
+			return r;
+		}
+	}
+	assert( false );
+	return -1;
+}
+
+void IrEmitter::release()
+{
+	while ( !m_saved.empty() ) {
+		m_out->emit("        pop%c %s\n", m_sfx, m_reg[m_saved.back()]);
+		m_saved.pop_back();
+	}
+}
+
+int IrEmitter::load(int pos, VReg v)
+{
+	if ( in_reg(v) ) return m_ra->reg(v);
+	int r = scratch(pos, all_regs);
+	m_out->emit("        mov%c %s, %s\n", m_sfx, operand(v).c_str(), m_reg[r]);
+	return r;
+}
+
+int IrEmitter::target(int pos, VReg d)
+{
+	if ( in_reg(d) ) return m_ra->reg(d);
+	return scratch(pos, all_regs);
+}
+
+void IrEmitter::store(int r, VReg d)
+{
+	if ( r != m_ra->reg(d) ) {
+		m_out->emit("        mov%c %s, %s\n", m_sfx, m_reg[r], operand(d).c_str());
+	}
+}
+
+void IrEmitter::emit_binary(int pos, IrInst & i, const char* op, bool commutative)
+{
+	int t = target(pos, i.dst);
+	if ( t == m_ra->reg(i.b) && t != m_ra->reg(i.a) ) {
+		//the result goes where the right operand is
+		if ( commutative ) {
+			m_out->emit("        %s%c %s, %s\n", op, m_sfx, operand(i.a).c_str(), m_reg[t]);
+		} else {
+			m_out->emit("        neg%c %s\n", m_sfx, m_reg[t]);
+			m_out->emit("        add%c %s, %s\n", m_sfx, operand(i.a).c_str(), m_reg[t]);
+		}
+	} else {
+		if ( t != m_ra->reg(i.a) ) {
+			m_out->emit("        mov%c %s, %s\n", m_sfx, operand(i.a).c_str(), m_reg[t]);
+		}
+		m_out->emit("        %s%c %s, %s\n", op, m_sfx, operand(i.b).c_str(), m_reg[t]);
+	}
+	store(t, i.dst);
+}
+
+void IrEmitter::emit_divide(IrInst & i)
+{
+	//idiv divides %edx:%eax (%rdx:%rax); nothing else is live in either
+	//register here (LinearScan::clobbers, and on x86-64 %rdx is never
+	//allocated) except possibly the operands, and a divisor there is
+	//moved out of the way
+	const char* extend = (m_target == tg_x86_64) ? "cqto" : "cdq";
+	int rb = m_ra->reg(i.b);
+	if ( rb >= 0 && (LinearScan::clobbers(ir_div, m_target) & (1u << rb)) ) {
+		m_out->emit("        push%c %s\n", m_sfx, m_reg[rb]);
+		if ( m_ra->reg(i.a) != r_eax ) {
+			m_out->emit("        mov%c %s, %s\n", m_sfx, operand(i.a).c_str(), m_reg[r_eax]);
+		}
+		m_out->emit("        %s\n", extend);
+		m_out->emit("        idiv%c (%s)\n", m_sfx, m_sp);
+		m_out->emit("        add%c $%d, %s\n", m_sfx, m_word, m_sp);
+	} else {
+		if ( m_ra->reg(i.a) != r_eax ) {
+			m_out->emit("        mov%c %s, %s\n", m_sfx, operand(i.a).c_str(), m_reg[r_eax]);
+		}
+		m_out->emit("        %s\n", extend);
+		m_out->emit("        idiv%c %s\n", m_sfx, operand(i.b).c_str());
+	}
+	if ( m_ra->reg(i.dst) != r_eax ) {
+		m_out->emit("        mov%c %s, %s\n", m_sfx, m_reg[r_eax], operand(i.dst).c_str());
+	}
+}
+
+//sets the flags from a compared to b
+void IrEmitter::emit_cmp(int pos, IrInst & i)
+{
+	if ( in_reg(i.a) || in_reg(i.b) ) {
+		m_out->emit("        cmp%c %s, %s\n", m_sfx, operand(i.b).c_str(), operand(i.a).c_str());
+	} else {
+		int ra = load(pos, i.a);
+		m_out->emit("        cmp%c %s, %s\n", m_sfx, operand(i.b).c_str(), m_reg[ra]);
+	}
+}
+
+void IrEmitter::emit_compare(int pos, IrInst & i, const char* set)
+{
+	emit_cmp(pos, i);
+
+	unsigned byte_regs = 0;
+	for( int r=0; r<num_machine_regs; r++ ) {
+		if ( m_byte[r] ) byte_regs |= 1u << r;
+	}
+	int t = m_ra->reg(i.dst);
+	if ( t < 0 || m_byte[t] == NULL ) t = scratch(pos, byte_regs);
+	m_out->emit("        %s %s\n", set, m_byte[t]);
+	m_out->emit("        movzb%c %s, %s\n", m_sfx, m_byte[t], m_reg[t]);
+	store(t, i.dst);
+}
+
+void IrEmitter::emit_branch(int pos, IrInst & i, const char* jcc)
+{
+	emit_cmp(pos, i);
+	//(a borrowed register has to be given back before the jump)
+	release();
+	m_out->emit("        %s %s%d\n", jcc, m_labels.c_str(), (int)i.imm);
+}
+
+// i386 pushed the arguments as ir_arg went; on x86-64 they were only
+// collected (the last argument first, the object at the end) and are put
+// into the argument registers here, since none of those is ever allocated
+void IrEmitter::emit_call(IrInst & i)
+{
+	const char* cls = Interner::spelling(i.cls);
+	const char* meth = Interner::spelling(i.meth);
+	if ( m_target == tg_i386 ) {
+		m_out->emit("        call %s_%s\n", cls, meth);
+		m_out->emit("        addl $%d, %%esp\n", (int)i.imm);
+	} else {
+		int n = m_args.size();
+		int on_stack = (n > sysv_reg_args) ? n - sysv_reg_args : 0;
+		int pad = (on_stack % 2) ? m_word : 0;
+		if ( pad ) m_out->emit("        subq $%d, %%rsp\n", pad);
+		for( int k=0; k<on_stack; k++ ) {
+			m_out->emit("        pushq %s\n", operand(m_args[k]).c_str());
+		}
+		for( int k=0; k<n-on_stack; k++ ) {
+			m_out->emit("        movq %s, %s\n", operand(m_args[n-1-k]).c_str(), sysv_arg_reg[k]);
+		}
+		m_out->emit("        call %s_%s\n", cls, meth);
+		if ( pad + on_stack*m_word ) {
+			m_out->emit("        addq $%d, %%rsp\n", pad + on_stack*m_word);
+		}
+		m_args.clear();
+	}
+	if ( m_ra->reg(i.dst) != r_eax ) {
+		m_out->emit("        mov%c %s, %s\n", m_sfx, m_reg[r_eax], operand(i.dst).c_str());
+	}
+}
+
+void IrEmitter::emit_epilogue()
+{
+	for( int r=0; r<num_machine_regs; r++ ) {
+		if ( m_save_offset[r] != 0 ) {
+			m_out->emit("        mov%c %d(%s), %s\n", m_sfx, m_save_offset[r], m_bp, m_reg[r]);
+		}
+	}
+	m_out->emit("        leave\n");
+	m_out->emit("        ret\n\n");
+}
+
+void IrEmitter::emit(int pos, IrInst & i)
+{
+	m_taken = 0;
+	if ( i.dst != no_vreg && in_reg(i.dst) ) m_taken |= 1u << m_ra->reg(i.dst);
+	if ( i.a != no_vreg && in_reg(i.a) ) m_taken |= 1u << m_ra->reg(i.a);
+	if ( i.b != no_vreg && in_reg(i.b) ) m_taken |= 1u << m_ra->reg(i.b);
+
+	const char* heap_top = (m_target == tg_x86_64) ? "_heap_top(%rip)" : "_heap_top";
+	int t, base, val;
+	switch( i.op ) {
+		case ir_const:
+			if ( i.imm < INT_MIN || i.imm > INT_MAX ) {
+				//only movabsq takes a 64 bit immediate, into a register
+				t = target(pos, i.dst);
+				m_out->emit("        movabsq $%lld, %s\n", i.imm, m_reg[t]);
+				store(t, i.dst);
+			} else {
+				m_out->emit("        mov%c $%lld, %s\n", m_sfx, i.imm, operand(i.dst).c_str());
+			}
+			break;
+		case ir_move:
+			val = load(pos, i.a);
+			store(val, i.dst);
+			break;
+		case ir_load_local:
+			t = target(pos, i.dst);
+			m_out->emit("        mov%c %d(%s), %s\n", m_sfx, (int)i.imm, m_bp, m_reg[t]);
+			store(t, i.dst);
+			break;
+		case ir_store_local:
+			val = load(pos, i.a);
+			m_out->emit("        mov%c %s, %d(%s)\n", m_sfx, m_reg[val], (int)i.imm, m_bp);
+			break;
+		case ir_load_field:
+			base = load(pos, i.a);
+			t = target(pos, i.dst);
+			m_out->emit("        mov%c %d(%s), %s\n", m_sfx, (int)i.imm, m_reg[base], m_reg[t]);
+			store(t, i.dst);
+			break;
+		case ir_store_field:
+			base = load(pos, i.a);
+			val = load(pos, i.b);
+			m_out->emit("        mov%c %s, %d(%s)\n", m_sfx, m_reg[val], (int)i.imm, m_reg[base]);
+			break;
+		case ir_add: emit_binary(pos, i, "add", true); break;
+		case ir_sub: emit_binary(pos, i, "sub", false); break;
+		case ir_mul: emit_binary(pos, i, "imul", true); break;
+		case ir_div: emit_divide(i); break;
+		case ir_lt: emit_compare(pos, i, "setl"); break;
+		case ir_le: emit_compare(pos, i, "setle"); break;
+		case ir_neg:
+		case ir_not:
+			t = target(pos, i.dst);
+			if ( t != m_ra->reg(i.a) ) {
+				m_out->emit("        mov%c %s, %s\n", m_sfx, operand(i.a).c_str(), m_reg[t]);
+			}
+			if ( i.op == ir_neg ) m_out->emit("        neg%c %s\n", m_sfx, m_reg[t]);
+			else m_out->emit("        xor%c $1, %s\n", m_sfx, m_reg[t]);
+			store(t, i.dst);
+			break;
+		case ir_arg:
+			if ( m_target == tg_x86_64 ) m_args.push_back(i.a);
+			else m_out->emit("        pushl %s\n", operand(i.a).c_str());
+			break;
+		case ir_call:
+			emit_call(i);
+			break;
+		case ir_print:
+			if ( m_target == tg_x86_64 ) {
+				m_out->emit("        movq %s, %%rdi\n", operand(i.a).c_str());
+				m_out->emit("        call Print\n");
+			} else {
+				m_out->emit("        pushl %s\n", operand(i.a).c_str());
+				m_out->emit("        call Print\n");
+				m_out->emit("        addl $%d, %%esp\n", m_word);
+			}
+			break;
+		case ir_alloc:
+			t = target(pos, i.dst);
+			m_out->emit("        mov%c %s, %s\n", m_sfx, heap_top, m_reg[t]);
+			m_out->emit("        add%c $%d, %s\n", m_sfx, (int)i.imm, heap_top);
+			store(t, i.dst);
+			break;
+		case ir_label:
+			m_out->emit("%s%d:\n", m_labels.c_str(), (int)i.imm);
+			break;
+		case ir_jump:
+			m_out->emit("        jmp %s%d\n", m_labels.c_str(), (int)i.imm);
+			break;
+		case ir_branch_false:
+		case ir_branch_true:
+			m_out->emit("        cmp%c $0, %s\n", m_sfx, operand(i.a).c_str());
+			m_out->emit("        %s %s%d\n", (i.op == ir_branch_true) ? "jne" : "je", m_labels.c_str(), (int)i.imm);
+			break;
+		case ir_branch_lt: emit_branch(pos, i, "jl"); break;
+		case ir_branch_le: emit_branch(pos, i, "jle"); break;
+		case ir_branch_ge: emit_branch(pos, i, "jge"); break;
+		case ir_branch_gt: emit_branch(pos, i, "jg"); break;
+		case ir_return:
+			if ( m_ra->reg(i.a) != r_eax ) {
+				m_out->emit("        mov%c %s, %s\n", m_sfx, operand(i.a).c_str(), m_reg[r_eax]);
+			}
+			emit_epilogue();
+			break;
+	}
+	release();
+}
+
+void IrEmitter::emit_method(const char* cls, const char* meth)
+{
+	m_labels = std::string(".L") + cls + "_" + meth + ".";
+	m_out->emit("%s_%s:\n", cls, meth);
+	m_out->emit("        push%c %s\n", m_sfx, m_bp);
+	m_out->emit("        mov%c %s, %s\n", m_sfx, m_sp, m_bp);
+	m_out->emit("        sub%c $%d,%s\n", m_sfx, frame_size(), m_sp);
+	for( int k=0; k<m_reg_args; k++ ) {
+		m_out->emit("        movq %s, %d(%%rbp)\n", sysv_arg_reg[k], -(k+1)*m_word);
+	}
+	for( int r=0; r<num_machine_regs; r++ ) {
+		if ( m_save_offset[r] != 0 ) {
+			m_out->emit("        mov%c %s, %d(%s)\n", m_sfx, m_reg[r], m_save_offset[r], m_bp);
+		}
+	}
+
+	for( int pos=0; pos<(int)m_f->m_code.size(); pos++ ) {
+		emit(pos, m_f->m_code[pos]);
+	}
+}
@@ -0,0 +1,132 @@
+#ifndef REGALLOC_HPP
+#define REGALLOC_HPP
+
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include "ir.hpp"
+#include "peephole.hpp"
+
+// the machines the code generators can write code for
+enum Target
+{
+	tg_i386,   // 32 bit words, cdecl: every argument is pushed on the stack
+	tg_x86_64  // 64 bit words, SysV: arguments go in registers
+};
+
+// on x86-64 the object and the first five arguments of a call are passed
+// in %rdi, %rsi, %rdx, %rcx, %r8 and %r9, any further ones on the stack
+static const int sysv_reg_args = 6;
+
+// the registers handed out to virtual registers, in the order they are
+// tried (the caller saved ones first, so short lived temporaries do not
+// cost a save/restore in the prologue).  The names are the i386 ones; on
+// x86-64 the same roles are played by %rax, %r10, %r11 (caller saved) and
+// %rbx, %r12, %r13 (callee saved), which keeps the argument registers out
+// of the allocation.
+enum MachineReg
+{
+	r_eax, r_ecx, r_edx, r_ebx, r_esi, r_edi,
+	num_machine_regs
+};
+
+// Linear scan register allocation (Poletto & Sarkar).  Each virtual
+// register lives from the instruction that defines it to its last use.
+// The intervals are walked in order of their start and given a free
+// machine register; when none is left the interval that ends last is
+// spilled to a frame slot for its whole lifetime.  An interval that is
+// live across a call (or a divide) is kept out of the registers that
+// instruction clobbers.
+class LinearScan
+{
+  struct Interval
+  {
+	VReg v;
+	int start, end;
+	unsigned forbidden; // mask of registers clobbered while it is live
+  };
+
+  IrFunction* m_f;
+  Target m_target;
+  std::vector<int> m_reg;       // indexed by VReg, -1 when spilled
+  std::vector<int> m_slot;      // indexed by VReg, -1 when in a register
+  std::vector<unsigned> m_busy; // indexed by instruction, registers in use there
+  int m_slots;
+  unsigned m_used;              // mask of every register handed out
+
+  public:
+
+  LinearScan(IrFunction* f, Target target);
+  void run();
+
+  //where v ended up: a register, or else a spill slot
+  int reg(VReg v) { return m_reg[v]; }
+  int slot(VReg v) { return m_slot[v]; }
+
+  //registers holding a value that is live at instruction pos (including
+  //the operands it reads last and the register it defines)
+  unsigned busy(int pos) { return m_busy[pos]; }
+
+  int spill_slots() { return m_slots; }
+  bool used(int r) { return (m_used & (1u << r)) != 0; }
+
+  //registers an instruction destroys as a side effect on target
+  static unsigned clobbers(IrOp op, Target target);
+};
+
+// Writes an allocated IrFunction out as i386 or x86-64 assembly (into the
+// same AsmBuffer the rest of the code generator writes to).  The frame is
+// the one Codegen lays out (on i386 the object at 8(%ebp) and the
+// arguments above it; on x86-64 the register arguments stored right below
+// %rbp by the prologue; then the locals) extended downwards by the spill
+// slots and by save slots for the callee saved registers the allocator
+// used.
+class IrEmitter
+{
+  AsmBuffer* m_out;
+  IrFunction* m_f;
+  LinearScan* m_ra;
+  Target m_target;
+  int m_word;               // bytes in a word
+  char m_sfx;               // the operand size suffix of a word: l or q
+  const char* const* m_reg; // names of the MachineRegs
+  const char* const* m_byte;// names of their low bytes (NULL if there is none)
+  const char* m_bp;         // the frame pointer
+  const char* m_sp;         // the stack pointer
+  int m_locals;             // bytes of locals below the frame pointer
+  int m_reg_args;           // words the prologue stores from argument registers
+  int m_save_offset[num_machine_regs]; // frame offset a callee saved register is kept at, or 0
+  unsigned m_taken;         // registers the current instruction may not borrow
+  std::vector<int> m_saved; // registers pushed around the current instruction
+  std::vector<VReg> m_args; // x86-64: the arguments of the next call so far
+  std::string m_labels;     // the labels of the method are this and a number
+
+  std::string operand(VReg v);
+  bool in_reg(VReg v) { return m_ra->reg(v) >= 0; }
+  int frame_size();
+
+  int scratch(int pos, unsigned allowed);
+  int load(int pos, VReg v);
+  int target(int pos, VReg d);
+  void store(int r, VReg d);
+  void release();
+
+  void emit(int pos, IrInst & i);
+  void emit_binary(int pos, IrInst & i, const char* op, bool commutative);
+  void emit_divide(IrInst & i);
+  void emit_cmp(int pos, IrInst & i);
+  void emit_compare(int pos, IrInst & i, const char* set);
+  void emit_branch(int pos, IrInst & i, const char* jcc);
+  void emit_call(IrInst & i);
+  void emit_epilogue();
+
+  public:
+
+  //locals_size counts everything Codegen keeps below the frame pointer;
+  //on x86-64 its top reg_args words are where the prologue stores the
+  //argument registers (the object at -8(%rbp), then the arguments)
+  IrEmitter(AsmBuffer* out, IrFunction* f, LinearScan* ra, Target target, int locals_size, int reg_args);
+  void emit_method(const char* cls, const char* meth);
+};
+
+#endif //REGALLOC_HPP
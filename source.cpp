@@ -0,0 +1,84 @@
+#include "source.hpp"
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/****** SourceFile Implementation **************************************/
+
+SourceFile::SourceFile()
+{
+	m_data = NULL;
+	m_size = 0;
+	m_mapped = 0;
+}
+
+SourceFile::~SourceFile()
+{
+	if ( m_mapped ) munmap(m_data, m_mapped);
+	else free(m_data);
+}
+
+bool SourceFile::open(const char* name)
+{
+	int fd = ::open(name, O_RDONLY);
+	if ( fd < 0 ) return false;
+	bool ok = load(fd);
+	close(fd); // a mapping stays valid after the descriptor is closed
+	return ok;
+}
+
+bool SourceFile::load(int fd)
+{
+	struct stat st;
+	if ( fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && lseek(fd, 0, SEEK_CUR) == 0 )
+		return map(fd, st.st_size);
+	return read_all(fd);
+}
+
+//the two zeros after the text come for free when they fit into the last
+//page of the file (the kernel fills the rest of it with zeros); in case
+//they do not, the whole range is first reserved as zeroed anonymous
+//memory and the file is mapped over the start of it
+bool SourceFile::map(int fd, size_t size)
+{
+	size_t page = sysconf(_SC_PAGESIZE);
+	size_t length = (size + 2 + page-1) / page * page;
+	void* p = mmap(NULL, length, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+	if ( p == MAP_FAILED ) return false;
+	if ( size > 0 && mmap(p, size, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_FIXED, fd, 0) == MAP_FAILED ) {
+		munmap(p, length);
+		return false;
+	}
+	madvise(p, length, MADV_SEQUENTIAL);
+	m_data = (char*)p;
+	m_size = size;
+	m_mapped = length;
+	return true;
+}
+
+bool SourceFile::read_all(int fd)
+{
+	size_t capacity = 64 * 1024;
+	char* data = (char*)malloc(capacity);
+	size_t size = 0;
+	for(;;) {
+		if ( size + 2 >= capacity ) {
+			capacity *= 2;
+			data = (char*)realloc(data, capacity);
+		}
+		ssize_t n = read(fd, data + size, capacity - size - 2);
+		if ( n < 0 ) {
+			free(data);
+			return false;
+		}
+		if ( n == 0 ) break;
+		size += n;
+	}
+	data[size] = data[size+1] = 0;
+	m_data = data;
+	m_size = size;
+	return true;
+}
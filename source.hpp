@@ -0,0 +1,39 @@
+#ifndef SOURCE_HPP
+#define SOURCE_HPP
+
+#include <stddef.h>
+
+// The text of one input, in memory the way the scanner wants it: size
+// bytes followed by two zero bytes, writable (flex puts a zero after the
+// token it is looking at, and takes it out again).  A regular file is
+// mapped rather than read, so the scanner works straight on the page
+// cache and tokens point into the mapping; only pages the scanner writes
+// to get a private copy.  Anything else (a pipe on stdin) is read into
+// a malloc'd block.
+class SourceFile
+{
+  char* m_data;
+  size_t m_size;     // bytes of text, not counting the two zeros
+  size_t m_mapped;   // bytes mapped, 0 if m_data was malloc'd
+
+  SourceFile(const SourceFile &);
+  SourceFile &operator=(const SourceFile &);
+
+  bool map(int fd, size_t size);
+  bool read_all(int fd);
+
+  public:
+
+  SourceFile();
+  ~SourceFile();
+
+  //loads the file called name; false if it cannot be read
+  bool open(const char* name);
+  //loads what is left of an open file descriptor
+  bool load(int fd);
+
+  char* data() { return m_data; }
+  size_t size() { return m_size; }
+};
+
+#endif //SOURCE_HPP
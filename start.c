@@ -4,7 +4,8 @@
   void Start(void*); 
 
   int main(int argc, char **argv) {
-      int * heap=(int*)malloc(sizeof(int)*10000);
+      // room for 10000 words of whichever target the program was built for
+      long * heap=(long*)malloc(sizeof(long)*10000);
       Start(heap);
       free(heap);
       return 0;
@@ -6,21 +6,20 @@
 
 /****** SymName Implemenation **************************************/
 
-SymName::SymName(char* const x)
+SymName::SymName(SymId x)
 {
-	m_spelling = x;
-	m_parent_attribute = NULL;
+	m_id = x;
+	m_symbol = NULL;
 }
 
 SymName::SymName(const SymName & other)
 {
-	m_spelling = strdup(other.m_spelling);
-	m_parent_attribute = other.m_parent_attribute;
+	m_id = other.m_id;
+	m_symbol = NULL;
 }
 
 SymName& SymName::operator=(const SymName & other)
 {
-	delete m_spelling;
 	SymName tmp(other);
 	swap(tmp);
 	return *this;
@@ -28,12 +27,11 @@ SymName& SymName::operator=(const SymName & other)
 
 void SymName::swap(SymName & other)
 {
-	std::swap(m_spelling, other.m_spelling);
+	std::swap(m_id, other.m_id);
 }
 
 SymName::~SymName()
 {
-	delete( m_spelling );
 }
 
 void SymName::accept(Visitor *v)
@@ -46,9 +44,14 @@ SymName* SymName::clone() const
 	return new SymName(*this);
 }
 
+SymId SymName::id()
+{
+	return m_id;
+}
+
 const char* SymName::spelling()
 {
-	return m_spelling;
+	return Interner::spelling(m_id);
 }
 
 const Symbol* SymName::symbol()
@@ -69,24 +72,33 @@ void SymName::set_symbol(Symbol* s)
 
 /****** SymTab Implementation **************************************/
 
-SymTab::SymTab()
+SymTab::SymTab(SymTabMode mode)
 {
-	m_head = new SymScope;
-	m_cur_scope = m_head;
+	m_head = NULL;
+	m_cur_scope = NULL;
+	m_flat = NULL;
+	m_level = 0;
+	if ( mode == st_flat ) {
+		m_flat = new SymFlat;
+	} else {
+		m_head = new SymScope;
+		m_cur_scope = m_head;
+	}
 }
 
 SymTab::~SymTab()
 {
 	delete m_head;
-}
-
-bool SymTab::is_dup_string(const char* name)
-{
-	return m_head->is_dup_string(name);
+	delete m_flat;
 }
 
 void SymTab::open_scope()
 {
+	m_level++;
+	if ( m_flat ) {
+		m_flat->open_scope();
+		return;
+	}
 	m_cur_scope = m_cur_scope->open_scope();
 	assert( m_cur_scope != NULL );
 }
@@ -94,69 +106,115 @@ void SymTab::open_scope()
 void SymTab::close_scope()
 {
 	//check to make sure we don't pop more than we push
+	assert( m_level > 0 );
+	m_level--;
+	if ( m_flat ) {
+		m_flat->close_scope();
+		return;
+	}
 	assert( m_cur_scope != m_head ); 
 	assert( m_cur_scope != NULL );
 
 	m_cur_scope = m_cur_scope->close_scope();
 }
 
+int SymTab::level()
+{
+	return m_level;
+}
+
+bool SymTab::exist( SymId name )
+{
+	assert( name != sym_none );
+	return lookup( name ) != NULL;
+}
+
 bool SymTab::exist(const char* name )
 {
 	assert( name != NULL );
-	return m_cur_scope->exist( name );
+	return exist( Interner::intern(name) );
 }
 
-bool SymTab::insert(const char* name, Symbol * s )
+bool SymTab::insert( SymId name, Symbol * s )
 {
-	assert( name != NULL );
+	assert( name != sym_none );
 	assert( s != NULL );
-	// the assert below fails, it is because you tried to insert
-	// a pointer to a string that is already in the SymTab.  You 
-	// can have duplicate names, but each needs to reside it it's
-	// own chunk of memory (see example)
-	//assert( is_dup_string(name) ); 
-	Symbol* r = m_cur_scope->insert( name, s );
+	Symbol* r = m_flat ? m_flat->insert( name, s, m_level )
+	                   : m_cur_scope->insert( name, s );
 	if ( r == NULL ) return true;
 	else return false;
 }
 
-bool SymTab::insert_in_parent_scope(const char* name, Symbol * s )
+bool SymTab::insert(const char* name, Symbol * s )
 {
 	assert( name != NULL );
+	return insert( Interner::intern(name), s );
+}
+
+bool SymTab::insert_in_parent_scope( SymId name, Symbol * s )
+{
+	assert( name != sym_none );
 	assert( s != NULL );
-	// the assert below fails, it is because you tried to insert
-	// a pointer to a string that is already in the SymTab.  You 
-	// can have duplicate names, but each needs to reside it it's
-	// own chunk of memory (see example)
-	//assert( is_dup_string(name) ); 
 	// make sure there is an actual parent scope
-	assert( m_cur_scope->m_parent != NULL );	
-	Symbol* r = m_cur_scope->m_parent->insert( name, s );
+	assert( m_level > 0 );
+	Symbol* r;
+	if ( m_flat ) {
+		r = m_flat->insert( name, s, m_level-1 );
+	} else {
+		assert( m_cur_scope->m_parent != NULL );	
+		r = m_cur_scope->m_parent->insert( name, s );
+	}
 	if ( r == NULL ) return true;
 	else return false;
 }
 
+bool SymTab::insert_in_parent_scope(const char* name, Symbol * s )
+{
+	assert( name != NULL );
+	return insert_in_parent_scope( Interner::intern(name), s );
+}
+
 SymScope* SymTab::get_current_scope()
 {
 	return m_cur_scope;
 }
 
+Symbol* SymTab::lookup( SymId name )
+{
+	assert( name != sym_none );
+	if ( m_flat ) return m_flat->lookup( name );
+	return m_cur_scope->lookup( name );
+}
+
 Symbol* SymTab::lookup( const char * name )
 {
 	assert( name != NULL );
-	return m_cur_scope->lookup( name );
+	return lookup( Interner::intern(name) );
 }
 
 Symbol* SymTab::lookup( SymName * name )
 {
 	assert( name != NULL );
-	return m_cur_scope->lookup( name->spelling() );
+	return lookup( name->id() );
+}
+
+Symbol* SymTab::lookup( SymId name, int level )
+{
+	assert( name != sym_none );
+	assert( level >= 0 && level <= m_level );
+	if ( m_flat ) return m_flat->lookup( name, level );
+
+	SymScope* scope = m_cur_scope;
+	for( int i=m_level; i>level; i-- ) scope = scope->m_parent;
+	SymScope::ScopeTableType::const_iterator si = scope->m_scopetable.find( name );
+	return ( si != scope->m_scopetable.end() ) ? si->second : NULL;
 }
 
 
 void SymTab::dump( FILE* f )
 {
-	m_head->dump(f, 0);
+	if ( m_flat ) m_flat->dump(f);
+	else m_head->dump(f, 0);
 }
 
 /****** SymScope Implementation **************************************/
@@ -176,20 +234,8 @@ SymScope::SymScope(SymScope * parent)
 
 SymScope::~SymScope()
 {
-	//delete the keys, but not the symbols (symbols are linked elsewhere)
-	ScopeTableType::iterator si, this_si;
-
-	si = m_scopetable.begin();
-	while ( si!=m_scopetable.end() )
-	{
-		std::string oldkey = si->first;
-		this_si = si;
-		++si;
-
-		m_scopetable.erase( this_si );
-	}
-
-	//now delete all the children
+	//the keys are interned ids and the symbols are linked
+	//elsewhere, so only the children need to be deleted
 	list<SymScope*>::iterator li;
 	for( li=m_child.begin(); li!=m_child.end(); ++li )
 	{
@@ -212,7 +258,7 @@ void SymScope::dump(FILE* f, int nest_level)
 	{
 		//indent appropriately
 		for( int i=0; i<nest_level; i++ ) { fprintf(f,"\t"); }
-		fprintf( f, "| %s \n", si->first.c_str() );
+		fprintf( f, "| %s \n", Interner::spelling(si->first) );
 	}
 	for( int i=0; i<nest_level; i++ ) { fprintf(f,"\t"); }
 	fprintf(f,"+-------------\n\n");
@@ -225,27 +271,6 @@ void SymScope::dump(FILE* f, int nest_level)
 	}
 }
 
-bool SymScope::is_dup_string(const char* name)
-{
-	ScopeTableType::iterator si;
-
-	si = m_scopetable.find( name );
-	if ( si != m_scopetable.end() ) {
-		//check if the pointers match
-		if ( si->first == name ) return false;
-	}
-
-	list<SymScope*>::iterator li;
-	for( li=m_child.begin(); li!=m_child.end(); ++li )
-	{
-		bool r = (*li)->is_dup_string(name);
-		if ( r==false ) return false;
-	}
-
-	//if it gets this far, there is no duplicate
-	return true;
-}
-
 void SymScope::add_child(SymScope* c) 
 {
 	m_child.push_back(c);
@@ -262,7 +287,7 @@ SymScope* SymScope::close_scope()
 	return m_parent;
 }
 
-bool SymScope::exist( const char* name )
+bool SymScope::exist( SymId name )
 {
 	Symbol* s;
 	s = lookup(name);
@@ -271,11 +296,16 @@ bool SymScope::exist( const char* name )
 	else return false;
 }
 
-Symbol* SymScope::insert( const char* name, Symbol * s )
+bool SymScope::exist( const char* name )
+{
+	return exist( Interner::intern(name) );
+}
+
+Symbol* SymScope::insert( SymId name, Symbol * s )
 {
 	pair<ScopeTableType::iterator,bool> iret;
-	typedef pair<std::string,Symbol*> hpair;
-	iret = m_scopetable.insert( hpair(std::string(name),s) );
+	typedef pair<SymId,Symbol*> hpair;
+	iret = m_scopetable.insert( hpair(name,s) );
 	if( iret.second == true ) {
 		//insert was successfull
 		return NULL;
@@ -286,11 +316,11 @@ Symbol* SymScope::insert( const char* name, Symbol * s )
 	}	
 }
  
-Symbol* SymScope::lookup( const char * name )
+Symbol* SymScope::lookup( SymId name )
 {
 	//first check the current table;
 	ScopeTableType::const_iterator i;
-	i = m_scopetable.find( std::string(name) );
+	i = m_scopetable.find( name );
 	if ( i != m_scopetable.end() ) {
 		return i->second;
 	}
@@ -303,3 +333,93 @@ Symbol* SymScope::lookup( const char * name )
 		return NULL;
 	}
 }
+
+Symbol* SymScope::lookup( const char * name )
+{
+	return lookup( Interner::intern(name) );
+}
+
+/****** SymFlat Implementation **************************************/
+
+void SymFlat::open_scope()
+{
+	m_marks.push_back( m_log.size() );
+}
+
+void SymFlat::close_scope()
+{
+	assert( !m_marks.empty() );
+	int closing = level();
+	size_t mark = m_marks.back();
+	m_marks.pop_back();
+
+	//the bindings of the closing scope are the innermost of their
+	//names; those made in an outer scope meanwhile (insert_in_parent_scope)
+	//stay, and go back on the log for that scope
+	m_kept.clear();
+	for( size_t k=m_log.size(); k>mark; k-- )
+	{
+		Record & r = m_log[k-1];
+		if ( r.level == closing ) m_bindings[r.name].pop_back();
+		else m_kept.push_back( r );
+	}
+	m_log.resize( mark );
+	m_log.insert( m_log.end(), m_kept.rbegin(), m_kept.rend() );
+}
+
+Symbol* SymFlat::insert( SymId name, Symbol * s, int level )
+{
+	std::vector<Binding> & stack = m_bindings[name];
+
+	//bindings of scopes inside level stay innermost
+	size_t i = stack.size();
+	while( i>0 && stack[i-1].level > level ) i--;
+	if ( i>0 && stack[i-1].level == level ) {
+		//cannot insert, there was a duplicate entry
+		return stack[i-1].symbol;
+	}
+
+	Binding b = { s, level };
+	stack.insert( stack.begin()+i, b );
+	Record r = { name, level };
+	m_log.push_back( r );
+	return NULL;
+}
+
+Symbol* SymFlat::lookup( SymId name )
+{
+	BindingMap::const_iterator i = m_bindings.find( name );
+	if ( i == m_bindings.end() || i->second.empty() ) return NULL;
+	return i->second.back().symbol;
+}
+
+Symbol* SymFlat::lookup( SymId name, int level )
+{
+	BindingMap::const_iterator i = m_bindings.find( name );
+	if ( i == m_bindings.end() ) return NULL;
+	const std::vector<Binding> & stack = i->second;
+	for( size_t k=stack.size(); k>0 && stack[k-1].level >= level; k-- )
+	{
+		if ( stack[k-1].level == level ) return stack[k-1].symbol;
+	}
+	return NULL;
+}
+
+void SymFlat::dump( FILE* f )
+{
+	//only the scopes still open are there to print, in the layout of
+	//SymScope::dump
+	for( int l=0; l<=level(); l++ )
+	{
+		for( int i=0; i<l; i++ ) { fprintf(f,"\t"); }
+		fprintf(f,"+-- Symbol Scope ---\n");
+		for( size_t k=0; k<m_log.size(); k++ )
+		{
+			if ( m_log[k].level != l ) continue;
+			for( int i=0; i<l; i++ ) { fprintf(f,"\t"); }
+			fprintf( f, "| %s \n", Interner::spelling(m_log[k].name) );
+		}
+		for( int i=0; i<l; i++ ) { fprintf(f,"\t"); }
+		fprintf(f,"+-------------\n\n");
+	}
+}
@@ -3,8 +3,10 @@
 
 #include "ast.hpp"
 #include "attribute.hpp"
+#include "intern.hpp"
 #include <cstring>
 #include <iostream>
+#include <list>
 #include <vector>
 #include <unordered_map>
 
@@ -15,24 +17,27 @@ typedef AllType Symbol;
 
 class SymName 
 {
-  char* m_spelling; // "name" of the symbol
+  SymId m_id; // interned "name" of the symbol
   Symbol* m_symbol; // pointer to the symbol for this name
 
   public:
 
   SymName(const SymName &);
   SymName &operator=(const SymName &);
-  SymName(char* const x);
+  SymName(SymId x);
   ~SymName();
   virtual void accept(Visitor *v);
   virtual SymName *clone() const;
+  // allocated in the current arena, like the generated nodes
+  static void* operator new(size_t size) { return Arena::current()->allocate(size); }
+  static void operator delete(void*) {}
   void swap(SymName &);
 
+  SymId id();
   const char* spelling();
   const Symbol* symbol();
   void set_symbol( Symbol* symbol );
 
-  Attribute* m_parent_attribute;
 };
 
 // this is one-level of scope for the SymTab
@@ -43,21 +48,21 @@ class SymScope
  
   SymScope* m_parent; 
   list<SymScope*> m_child;       
-        typedef std::unordered_map<string, Symbol*, 
-                                  std::hash<std::string> > ScopeTableType; 
+        typedef std::unordered_map<SymId, Symbol*> ScopeTableType; 
  
   ScopeTableType m_scopetable; 
 public:
   SymScope* parent(); 
   void add_child(SymScope* c); 
   SymScope(SymScope * parent); 
-  bool is_dup_string(const char* name); //used for error check 
  
   void dump( FILE* f, int nest_level ); 
   SymScope* open_scope(); 
   SymScope* close_scope(); 
+  bool exist( SymId name ); 
+  Symbol* insert( SymId name, Symbol * s );  
+  Symbol* lookup( SymId name );  
   bool exist( const char* name ); 
-  Symbol* insert( const char* name, Symbol * s );  
   Symbol* lookup( const char * name );  
  
   SymScope(); 
@@ -66,46 +71,108 @@ public:
   friend class SymTab; //symtab is a wrapper class 
  
 }; 
+
+// The flat way to keep the scopes of a SymTab: one table from each name
+// to the stack of its bindings, innermost last, so a lookup is one probe
+// however deeply the scopes nest.  Opening a scope only marks the undo
+// log; closing it pops the bindings the log has for it.  Nothing is kept
+// of a scope once it is closed, and a name's stack is reused by the next
+// scope that binds it.
+class SymFlat
+{
+  struct Binding
+  {
+    Symbol* symbol;
+    int level;     // the scope it is in, 0 being the outermost
+  };
+
+  struct Record
+  {
+    SymId name;
+    int level;
+  };
+
+  typedef std::unordered_map<SymId, std::vector<Binding> > BindingMap;
+
+  BindingMap m_bindings;
+  std::vector<Record> m_log;     // the bindings made, in order
+  std::vector<size_t> m_marks;   // where each open scope starts in m_log
+  std::vector<Record> m_kept;    // close_scope: those of outer scopes
+
+public:
+  int level() { return (int)m_marks.size(); }
+  void open_scope();
+  void close_scope();
+
+  //binds name to s in the open scope at level; NULL if that worked, or
+  //the symbol name already has there
+  Symbol* insert( SymId name, Symbol * s, int level );
+  Symbol* lookup( SymId name );
+  Symbol* lookup( SymId name, int level );
+
+  void dump( FILE* f );
+};
+
+enum SymTabMode
+{
+  st_flat,  // SymFlat: lookups take one probe, closed scopes are dropped
+  st_tree   // a tree of SymScopes, kept whole for dump
+};
 	
 // This is the symbol table header which is similar
 // to the interface described in class.  There is a
 // open and close scope to grow a symbol table tree.
 // lookup and exist recurisively search all of the 
 // parent scopes, while insert considers only the
-// current scope.
+// current scope.  Names are interned ids; the
+// const char* versions intern the spelling first.
+// The scopes are kept as a tree (st_tree) or flat
+// (st_flat, the default); only the tree keeps the
+// closed scopes for dump.
 class SymTab
 {
   private:
   SymScope* m_head;
   SymScope* m_cur_scope;
-  bool is_dup_string(const char*);
+  SymFlat* m_flat;   // NULL with st_tree
+  int m_level;
 
   public:
 
-  SymTab();
+  SymTab(SymTabMode mode = st_flat);
   ~SymTab();
 
   void open_scope();
   void close_scope();
 
+  //how many scopes are open (the outermost one is not counted)
+  int level();
+
   //returns true if name is found in the current SymScope
   //or any of the parent SymScopes
+  bool exist( SymId name );
   bool exist(const char* name );
 
   //tries to insert a pointer to s into the symbol table and
   //returns true if successful.  
+  bool insert( SymId name, Symbol * s ); 
   bool insert(const char* name, Symbol * s ); 
 
   //does an insert into the parent scope of the working scope
   //(it will have an assert failure if there is no parent scope)
+  bool insert_in_parent_scope( SymId name, Symbol * s ); 
   bool insert_in_parent_scope(const char* name, Symbol * s ); 
 
   //tries to locate name in the current SymScope and all
   //of the parent SymScopes
+  Symbol* lookup( SymId name ); 
   Symbol* lookup( const char * name ); 
   Symbol* lookup( SymName * name ); 
 
-  //get current scope
+  //locates name in the open scope at level only
+  Symbol* lookup( SymId name, int level ); 
+
+  //get current scope (NULL with st_flat)
   SymScope* get_current_scope();
 
   //dump the contents of the symbol table to the file
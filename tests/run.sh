@@ -0,0 +1,79 @@
+#!/bin/sh
+# usage: tests/run.sh [lang]  (from the top directory, after make)
+#
+# Compiles every tests/*.lang in each of the modes below, both straight to
+# an object and through -S and the system assembler, links it with
+# start.c and compares what it prints with tests/<name>.out.  CC is the
+# compiler used to link (gcc by default); the i386 modes are skipped when
+# it cannot link -m32 programs (it needs its 32 bit libraries for that).
+# Then units.lang is compiled with -fincremental, one of its classes is
+# edited and it is compiled again, as checked at the end.
+LANG_BIN=${1:-./lang}
+CC=${CC:-gcc}
+DIR=$(dirname "$0")
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+
+MODES="-O0|-O1|-O2|-fregalloc|-O1 -fregalloc|-m64 -fregalloc|-m64 -O1 -fregalloc"
+
+echo 'void Start(void* heap) { }' > "$WORK/probe.c"
+if $CC -m32 -o "$WORK/probe" "$DIR/../start.c" "$WORK/probe.c" 2> /dev/null; then
+  m32=yes
+else
+  m32=no
+  echo "$CC cannot link -m32 programs, skipping the i386 modes"
+fi
+
+fail=0
+count=0
+for src in "$DIR"/*.lang; do
+  name=$(basename "$src" .lang)
+  IFS='|'
+  for mode in $MODES; do
+    unset IFS
+    case "$mode" in *-m64*) arch=-m64 ;; *) arch=-m32 ;; esac
+    if [ $arch = -m32 ] && [ $m32 = no ]; then
+      IFS='|'
+      continue
+    fi
+    for out in o s; do
+      flags="$mode"
+      [ $out = s ] && flags="$mode -S"
+      count=$((count+1))
+      if ! $LANG_BIN $flags -o "$WORK/$name.$out" < "$src" > /dev/null 2> "$WORK/diag.txt" ||
+         ! $CC $arch -o "$WORK/prog" "$DIR/../start.c" "$WORK/$name.$out" 2>> "$WORK/diag.txt"; then
+        echo "FAIL $name ($flags): did not build"
+        cat "$WORK/diag.txt"
+        fail=$((fail+1))
+      elif ! "$WORK/prog" | cmp -s - "$DIR/$name.out"; then
+        echo "FAIL $name ($flags)"
+        fail=$((fail+1))
+      fi
+    done
+    IFS='|'
+  done
+  unset IFS
+done
+
+# -fincremental: once Counter is edited only it and the two classes that
+# name it are compiled again, into the same code a full compile makes
+count=$((count+1))
+sed 's/n = n + v;/n = n + v + 1;/' "$DIR/units.lang" > "$WORK/edit.lang"
+inc="-S -fincremental -fcache=$WORK/cache -ftime-report"
+if ! $LANG_BIN $inc -o "$WORK/units.s" < "$DIR/units.lang" > /dev/null 2> "$WORK/diag.txt" ||
+   ! $LANG_BIN $inc -o "$WORK/edit.s" < "$WORK/edit.lang" > /dev/null 2> "$WORK/diag.txt" ||
+   ! $LANG_BIN -S -o "$WORK/full.s" < "$WORK/edit.lang" > /dev/null 2>> "$WORK/diag.txt"; then
+  echo "FAIL units (-fincremental): did not build"
+  cat "$WORK/diag.txt"
+  fail=$((fail+1))
+elif ! grep -q "classes: 3 of 4 compiled" "$WORK/diag.txt"; then
+  echo "FAIL units (-fincremental): expected 3 of 4 classes compiled"
+  grep "classes:" "$WORK/diag.txt"
+  fail=$((fail+1))
+elif ! cmp -s "$WORK/edit.s" "$WORK/full.s"; then
+  echo "FAIL units (-fincremental): differs from a full compile"
+  fail=$((fail+1))
+fi
+
+echo "$((count-fail)) of $count passed"
+[ $fail = 0 ]
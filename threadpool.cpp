@@ -0,0 +1,58 @@
+#include "threadpool.hpp"
+#include <thread>
+
+/****** ThreadPool Implementation **************************************/
+
+ThreadPool::ThreadPool(int threads)
+{
+	m_threads = (threads < 1) ? 1 : threads;
+	for( int k=0; k<m_threads; k++ ) m_queues.push_back(new Queue);
+}
+
+ThreadPool::~ThreadPool()
+{
+	for( size_t k=0; k<m_queues.size(); k++ ) delete m_queues[k];
+}
+
+//the next task for a worker: its own newest one, or else the oldest one
+//of the first other worker that has any; false when all are empty
+bool ThreadPool::take(int worker, std::function<void()> & task)
+{
+	for( int k=0; k<m_threads; k++ ) {
+		Queue* q = m_queues[(worker+k) % m_threads];
+		std::lock_guard<std::mutex> hold(q->lock);
+		if ( q->tasks.empty() ) continue;
+		if ( k == 0 ) {
+			task = q->tasks.back();
+			q->tasks.pop_back();
+		} else {
+			task = q->tasks.front();
+			q->tasks.pop_front();
+		}
+		return true;
+	}
+	return false;
+}
+
+//no task makes new ones, so once every queue is empty the worker is done
+void ThreadPool::work(int worker)
+{
+	std::function<void()> task;
+	while ( take(worker, task) ) task();
+}
+
+void ThreadPool::run(std::vector<std::function<void()> > & tasks)
+{
+	for( size_t k=0; k<tasks.size(); k++ ) m_queues[k % m_threads]->tasks.push_back(tasks[k]);
+
+	int threads = (tasks.size() < (size_t)m_threads) ? (int)tasks.size() : m_threads;
+	if ( threads <= 1 ) {
+		work(0);
+		return;
+	}
+
+	std::vector<std::thread> workers;
+	for( int k=1; k<threads; k++ ) workers.push_back(std::thread(&ThreadPool::work, this, k));
+	work(0);
+	for( size_t k=0; k<workers.size(); k++ ) workers[k].join();
+}
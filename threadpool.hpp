@@ -0,0 +1,37 @@
+#ifndef THREADPOOL_HPP
+#define THREADPOOL_HPP
+
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+// Runs a batch of independent tasks (the compilation of one input file
+// each) on a fixed number of threads.  The tasks are dealt out to the
+// workers up front, one queue per worker; a worker takes work from the
+// back of its own queue, and when that runs dry it steals from the front
+// of another's, so a few long files do not leave the other threads idle.
+class ThreadPool
+{
+  struct Queue
+  {
+    std::mutex lock;
+    std::deque<std::function<void()> > tasks;
+  };
+
+  int m_threads;
+  std::vector<Queue*> m_queues; // one per worker
+
+  bool take(int worker, std::function<void()> & task);
+  void work(int worker);
+
+  public:
+
+  ThreadPool(int threads);
+  ~ThreadPool();
+
+  //runs every task and returns when they are all done
+  void run(std::vector<std::function<void()> > & tasks);
+};
+
+#endif //THREADPOOL_HPP
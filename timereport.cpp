@@ -0,0 +1,158 @@
+#include "timereport.hpp"
+#include <new>
+#include <stdlib.h>
+#include <time.h>
+#include <sys/resource.h>
+
+/****** allocation counting **************************************/
+
+// every operator new of the program is counted here (operator new[] and
+// the nothrow forms end up in this one)
+static thread_local unsigned long long heap_allocs = 0;
+static thread_local unsigned long long heap_bytes = 0;
+
+void* operator new(size_t size)
+{
+	heap_allocs++;
+	heap_bytes += size;
+	void* p = malloc(size ? size : 1);
+	if ( !p ) throw std::bad_alloc();
+	return p;
+}
+
+void operator delete(void* p) noexcept
+{
+	free(p);
+}
+
+void operator delete(void* p, size_t) noexcept
+{
+	free(p);
+}
+
+/****** TimeReport Implementation **************************************/
+
+static double seconds(clockid_t clock)
+{
+	struct timespec ts;
+	clock_gettime(clock, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static long peak_rss_kb()
+{
+	struct rusage ru;
+	getrusage(RUSAGE_SELF, &ru);
+	return ru.ru_maxrss; // kilobytes on Linux
+}
+
+TimeReport::TimeReport(bool on, Arena* arena)
+{
+	m_on = on;
+	m_arena = arena;
+	m_current = NULL;
+}
+
+TimeReport::Sample TimeReport::sample()
+{
+	Sample s;
+	s.wall = seconds(CLOCK_MONOTONIC);
+	s.cpu = seconds(CLOCK_THREAD_CPUTIME_ID);
+	s.allocs = heap_allocs;
+	s.bytes = heap_bytes;
+	s.arena_allocs = m_arena->allocation_count();
+	s.arena_bytes = m_arena->bytes_allocated();
+	return s;
+}
+
+void TimeReport::begin(const char* phase)
+{
+	if ( !m_on ) return;
+	m_current = phase;
+	m_start = sample();
+}
+
+void TimeReport::end()
+{
+	if ( !m_on || !m_current ) return;
+	Sample s = sample();
+	Phase p;
+	p.name = m_current;
+	p.wall = s.wall - m_start.wall;
+	p.cpu = s.cpu - m_start.cpu;
+	p.allocs = s.allocs - m_start.allocs;
+	p.bytes = s.bytes - m_start.bytes;
+	p.arena_allocs = s.arena_allocs - m_start.arena_allocs;
+	p.arena_bytes = s.arena_bytes - m_start.arena_bytes;
+	p.peak_rss_kb = peak_rss_kb();
+	m_phases.push_back(p);
+	m_current = NULL;
+}
+
+void TimeReport::note(const char* name, const std::string & value)
+{
+	if ( !m_on ) return;
+	m_notes.push_back(std::make_pair(name, value));
+}
+
+TimeReport::Phase TimeReport::total()
+{
+	Phase t = { "total", 0, 0, 0, 0, 0, 0, peak_rss_kb() };
+	for( size_t k=0; k<m_phases.size(); k++ ) {
+		t.wall += m_phases[k].wall;
+		t.cpu += m_phases[k].cpu;
+		t.allocs += m_phases[k].allocs;
+		t.bytes += m_phases[k].bytes;
+		t.arena_allocs += m_phases[k].arena_allocs;
+		t.arena_bytes += m_phases[k].arena_bytes;
+	}
+	return t;
+}
+
+void TimeReport::print_text(FILE* out, const char* file)
+{
+	if ( !m_on ) return;
+	if ( file ) fprintf(out, "%s:\n", file);
+	fprintf(out, "%-16s %10s %10s %10s %12s %12s %12s %12s\n", "phase", "wall ms", "cpu ms",
+	        "allocs", "bytes", "arena allocs", "arena bytes", "peak RSS KB");
+	for( size_t k=0; k<=m_phases.size(); k++ ) {
+		Phase p = (k < m_phases.size()) ? m_phases[k] : total();
+		fprintf(out, "%-16s %10.3f %10.3f %10llu %12llu %12zu %12zu %12ld\n", p.name, p.wall*1e3, p.cpu*1e3,
+		        p.allocs, p.bytes, p.arena_allocs, p.arena_bytes, p.peak_rss_kb);
+	}
+	for( size_t k=0; k<m_notes.size(); k++ ) fprintf(out, "%s: %s\n", m_notes[k].first, m_notes[k].second.c_str());
+}
+
+//s as a JSON string (a file name may have quotes or backslashes)
+static void json_string(FILE* out, const char* s)
+{
+	fputc('"', out);
+	for( ; *s; s++ ) {
+		if ( *s == '"' || *s == '\\' ) fprintf(out, "\\%c", *s);
+		else if ( (unsigned char)*s < 0x20 ) fprintf(out, "\\u%04x", (unsigned char)*s);
+		else fputc(*s, out);
+	}
+	fputc('"', out);
+}
+
+void TimeReport::print_json(FILE* out, const char* file)
+{
+	if ( !m_on ) return;
+	fprintf(out, "{");
+	if ( file ) {
+		fprintf(out, "\"file\": ");
+		json_string(out, file);
+		fprintf(out, ", ");
+	}
+	fprintf(out, "\"phases\": [");
+	for( size_t k=0; k<=m_phases.size(); k++ ) {
+		Phase p = (k < m_phases.size()) ? m_phases[k] : total();
+		if ( k == m_phases.size() ) fprintf(out, "], \"total\": ");
+		else if ( k > 0 ) fprintf(out, ", ");
+		fprintf(out, "{\"name\": \"%s\", \"wall_ms\": %.3f, \"cpu_ms\": %.3f, \"allocs\": %llu, \"bytes\": %llu, "
+		        "\"arena_allocs\": %zu, \"arena_bytes\": %zu, \"peak_rss_kb\": %ld}",
+		        p.name, p.wall*1e3, p.cpu*1e3, p.allocs, p.bytes, p.arena_allocs, p.arena_bytes, p.peak_rss_kb);
+	}
+	for( size_t k=0; k<m_notes.size(); k++ ) fprintf(out, ", \"%s\": \"%s\"", m_notes[k].first, m_notes[k].second.c_str());
+	fprintf(out, "}\n");
+}
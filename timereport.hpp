@@ -0,0 +1,62 @@
+#ifndef TIMEREPORT_HPP
+#define TIMEREPORT_HPP
+
+#include <stdio.h>
+#include <string>
+#include <utility>
+#include <vector>
+#include "arena.hpp"
+
+// What each phase of a compilation cost, for -ftime-report: wall and CPU
+// time, the heap allocations (operator new) and arena allocations made
+// during the phase, and the peak resident set size of the process at its
+// end.  The driver brackets every phase with begin() and end(); when the
+// report is off those only test a flag.
+//
+// The heap counters are kept per thread and the CPU time is that of the
+// calling thread, so a report describes the work of the thread that
+// made it.
+class TimeReport
+{
+  struct Sample
+  {
+    double wall, cpu;              // seconds
+    unsigned long long allocs, bytes;
+    size_t arena_allocs, arena_bytes;
+  };
+
+  struct Phase
+  {
+    const char* name;
+    double wall, cpu;
+    unsigned long long allocs, bytes;
+    size_t arena_allocs, arena_bytes;
+    long peak_rss_kb;
+  };
+
+  bool m_on;
+  Arena* m_arena;
+  Sample m_start;
+  const char* m_current;
+  std::vector<Phase> m_phases;
+  std::vector<std::pair<const char*, std::string> > m_notes;
+
+  Sample sample();
+  Phase total();
+
+  public:
+
+  TimeReport(bool on, Arena* arena);
+
+  void begin(const char* phase);
+  void end();
+
+  //adds a line that is not a phase ("cache", "hit"), printed after them
+  void note(const char* name, const std::string & value);
+
+  //file names the input the report is about, when there are several
+  void print_text(FILE* out, const char* file = NULL);
+  void print_json(FILE* out, const char* file = NULL);
+};
+
+#endif //TIMEREPORT_HPP
@@ -0,0 +1,27 @@
+#include "trace.hpp"
+#include <string.h>
+
+static const char* category_name[num_trace_categories] =
+	{ "layout", "frame", "calls", "vars" };
+
+unsigned Trace::s_enabled = 0;
+
+bool Trace::enable(const char* list)
+{
+	while ( *list ) {
+		size_t n = strcspn(list, ",");
+		int c;
+		if ( n == 3 && strncmp(list, "all", 3) == 0 ) {
+			s_enabled = (1u << num_trace_categories) - 1;
+		} else {
+			for( c=0; c<num_trace_categories; c++ ) {
+				if ( strlen(category_name[c]) == n && strncmp(list, category_name[c], n) == 0 ) break;
+			}
+			if ( c == num_trace_categories ) return false;
+			s_enabled |= 1u << c;
+		}
+		list += n;
+		if ( *list == ',' ) list++;
+	}
+	return true;
+}
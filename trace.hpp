@@ -0,0 +1,54 @@
+#ifndef TRACE_HPP
+#define TRACE_HPP
+
+#include <iostream>
+
+// Debug tracing.  A trace point names a category and a level, and the
+// message is anything that can be put on an ostream:
+//
+//   TRACE(tr_layout, 1, "## Param: '" << name << "', offset: " << offset);
+//
+// Trace points are only compiled in when the compiler is built with
+// TRACE_LEVEL set (make TRACE_LEVEL=2); in a normal build every one of
+// them expands to nothing, and so do those above the level built in.  At
+// run time -ftrace=<categories> picks which of the compiled in ones print
+// (to stderr).
+//
+//   level 1: once per class or method
+//   level 2: once per statement or expression
+
+#ifndef TRACE_LEVEL
+#define TRACE_LEVEL 0
+#endif
+
+enum TraceCategory
+{
+  tr_layout,  // where fields, parameters and locals are placed
+  tr_frame,   // method prologues and epilogues
+  tr_calls,   // method calls and their arguments
+  tr_vars,    // variable reads and assignments
+  num_trace_categories
+};
+
+class Trace
+{
+  static unsigned s_enabled; // a bit per TraceCategory
+
+  public:
+
+  //turns on the categories in a comma separated list of their names
+  //("all" is every one); false if a name is not known
+  static bool enable(const char* list);
+  static bool enabled(TraceCategory c) { return (s_enabled & (1u << c)) != 0; }
+};
+
+#if TRACE_LEVEL > 0
+#define TRACE(category, level, message) \
+  do { \
+    if ( (level) <= TRACE_LEVEL && Trace::enabled(category) ) std::cerr << message << std::endl; \
+  } while (0)
+#else
+#define TRACE(category, level, message) do { } while (0)
+#endif
+
+#endif //TRACE_HPP
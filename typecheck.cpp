@@ -3,6 +3,8 @@
 #include "symtab.hpp"
 #include "primitive.hpp"
 #include "classhierarchy.hpp"
+#include "compileerror.hpp"
+#include "classunits.hpp"
 #include "assert.h"
 #include <typeinfo>
 #include <stdio.h>
@@ -19,19 +21,31 @@
     error condition that should be thrown when it fails. Every error condition listed there and also in the "errortype" enum in
     this file must be used somewhere in your code.
     
-    Be careful when throwing errors - always throw an error of the right type, using the m_attribute of the node you're visiting
+    Be careful when throwing errors - always throw an error of the right type, using the node you're visiting
     when performing the check. Sometimes you'll see errors being thrown at strange line numbers; that is okay, don't let that
     bother you as long as you follow the above principle.
 
 *****/
 
-class Typecheck : public Visitor {
+class Typecheck final : public Visitor, public StaticVisitor<Typecheck> {
     private:
     FILE* m_errorfile;
+    const char* m_symtab_dump; // where to dump the symbol table to, or NULL
     SymTab* m_symboltable;
     ClassTable* m_classtable;
+    AttributeTable* m_attributes;
     ClassName* current_class_name;
+    int m_class_level;  // the symbol table scope of the class being checked
     bool just_return;
+
+    // with -fincremental: the classes whose code is in the cache, whose
+    // methods are only declared, not checked again
+    ClassUnits* m_units;
+    bool m_signatures_only;
+
+    // interned names the checker needs to recognize
+    SymId program_id;
+    SymId start_id;
     
     const char * bt_to_string(Basetype bt) {
         switch (bt) {
@@ -46,6 +60,29 @@ class Typecheck : public Visitor {
         }
     }
     
+    // what name stands for in class cls: a member of its own or one it
+    // inherits, NULL if neither.  The table of the members is made when a
+    // class has been checked; until then (for the class being checked)
+    // its own members so far are in its scope
+    Symbol* member_of(ClassNode* cls, SymId name) {
+      if(cls == NULL) return NULL;
+      if(cls->members == NULL){
+        Symbol* s = NULL;
+        if(current_class_name && cls->name->id() == current_class_name->id())
+          s = m_symboltable->lookup(name, m_class_level);
+        if(s != NULL) return s;
+        cls = m_classtable->getParentOf(cls);
+      }
+      const Member* m = m_classtable->member(cls, name);
+      return m ? m->symbol : NULL;
+    }
+
+    // the attributes of a node live in the side table, not in the node
+    template <class Node>
+    CompoundType& type_of(Node* p) { return m_attributes->type(p); }
+    template <class Node>
+    MethodType& signature_of(Node* p) { return m_attributes->signature(p); }
+    
     // the set of recognized errors
     enum errortype 
     {
@@ -69,9 +106,9 @@ class Typecheck : public Visitor {
     };
     
     // Throw errors using this method
-    void t_error( errortype e, Attribute a ) 
+    void t_error( errortype e, Visitable* p ) 
     {
-        fprintf(m_errorfile,"on line number %d, ", a.lineno );
+        fprintf(m_errorfile,"on line number %d, ", p->m_lineno );
         
         switch( e ) {
             case no_program: fprintf(m_errorfile,"error: no Program class\n"); break;
@@ -95,86 +132,101 @@ class Typecheck : public Visitor {
             
             default: fprintf(m_errorfile,"error: no good reason\n"); break;
         }
-        exit(1);
+        throw CompileError();
     }
     
     public:
     
-    Typecheck(FILE* errorfile, SymTab* symboltable,ClassTable*ct) {
+    Typecheck(FILE* errorfile, SymTab* symboltable,ClassTable*ct, AttributeTable* at, const char* symtab_dump = NULL, ClassUnits* units = NULL) {
         m_errorfile = errorfile;
+        m_units = units;
+        m_signatures_only = false;
+        m_symtab_dump = symtab_dump;
+        m_attributes = at;
         m_symboltable = symboltable;
         m_classtable = ct;
+        current_class_name = NULL;
+        m_class_level = 0;
+        program_id = Interner::intern("Program");
+        start_id = Interner::intern("start");
     }
     void visitProgramImpl(ProgramImpl *p) {
 
       //WRITE ME
       just_return = true;
-      list<Class_ptr>::iterator class_i;
+
+      // all the classes are declared before any of them is checked, so the
+      // hierarchy is complete, and numbered for isSubclassOf, by then
+      Class_list::iterator class_i;
       forall(class_i, p->m_class_list){
-        m_symboltable->open_scope();
         ClassImpl* c = ((ClassImpl*)(*class_i));
-        char* className = strdup(((ClassIDImpl*)c->m_classid_1)->m_classname->spelling());
+        ClassName* className = ((ClassIDImpl*)c->m_classid_1)->m_classname;
 
-        char* superClass = NULL;
         if((c->m_classid_2) != NULL){
-          superClass = strdup(((ClassIDImpl*)c->m_classid_2)->m_classname->spelling());
-          if(m_classtable->exist(superClass)){
-            // if superclass than add it below that scope? how else we'll we be able to check stuff
-            // SymScope *scope = new SymScope();
-            // scope = m_symboltable->get_current_scope();
-            m_classtable->insert(new ClassName(className), new ClassName(superClass), c, m_symboltable->get_current_scope());
-
-            current_class_name = ((ClassIDImpl*)c->m_classid_1)->m_classname;
-
-            visitClassImpl(c);
+          // a superclass has to come before its subclasses
+          ClassName* superClass = ((ClassIDImpl*)c->m_classid_2)->m_classname;
+          if(!m_classtable->exist(superClass))
+            this->t_error(sym_name_undef, p);
 
-            // m_symboltable->get_current_scope()->add_child(scope);
-          } else {
-            this->t_error(sym_name_undef, p->m_attribute);
-          }
+          m_classtable->insert(className, superClass, c);
         } else {
           // 4. No two classes may have the same name
           if(m_classtable->exist(className))
-            this->t_error(dup_ident_name, p->m_attribute);
+            this->t_error(dup_ident_name, p);
 
-          m_classtable->insert(new ClassName(className), NULL, c, m_symboltable->get_current_scope());
+          m_classtable->insert(className, NULL, c);
+        }
+      }
+      m_classtable->freeze();
+
+      forall(class_i, p->m_class_list){
+        m_symboltable->open_scope();
+        ClassImpl* c = ((ClassImpl*)(*class_i));
+        current_class_name = ((ClassIDImpl*)c->m_classid_1)->m_classname;
+        ClassNode* node = m_classtable->lookup(current_class_name);
+        m_class_level = m_symboltable->level();
 
-          current_class_name = ((ClassIDImpl*)c->m_classid_1)->m_classname;
+        visitClassImpl(c);
+        m_classtable->seal(node, m_symboltable);
 
-          visitClassImpl(c);
-        }
         m_symboltable->close_scope();
       }
 
 
       // p->visit_children(this);
-      FILE *symFile;
-      symFile = fopen("symboltable.txt" , "w");
-      m_symboltable->dump(symFile);
+      if(m_symtab_dump){
+        FILE *symFile = fopen(m_symtab_dump, "w");
+        if(symFile){
+          m_symboltable->dump(symFile);
+          fclose(symFile);
+        }
+      }
       
       // 1. Every input program is required to have a class called "Program"
       // This class must appear as the last class in the program.
-      char *programName = strdup(p->m_class_list->back()->m_attribute.m_type.classType.classID);
-      if(strcmp(programName, "Program") != 0)
-        this->t_error(no_program, p->m_attribute);
+      if(p->m_class_list->empty())
+        this->t_error(no_program, p);
+      SymId programName = type_of(p->m_class_list->back()).classID;
+      if(programName != program_id)
+        this->t_error(no_program, p);
 
       ClassNode *program = m_classtable->lookup(programName);
       bool foundStart = false;
-      list<Method_ptr>::iterator meth_i;
+      Method_list::iterator meth_i;
       forall(meth_i, program->p->m_method_list){
         // 2. The required Program class must have a method called "start".
         // TODO: This start method must return the type Nothing.
-        if(strcmp((*meth_i)->m_attribute.m_type.classType.classID, "start") == 0 && (*meth_i)->m_attribute.m_type.methodType.returnType.baseType == bt_nothing){
+        if(type_of((*meth_i)).classID == start_id && signature_of((*meth_i)).returnType.baseType == bt_nothing){
           foundStart = true;
 
           // 3. The required "start" method takes exactly zero parameters.
-          if((*meth_i)->m_attribute.m_type.methodType.argsType.size() > 0)
-            this->t_error(start_args_err, p->m_attribute);
+          if(signature_of((*meth_i)).argsType.size() > 0)
+            this->t_error(start_args_err, p);
         }
 
       }
       if(!foundStart)
-        this->t_error(no_start, p->m_attribute);
+        this->t_error(no_start, p);
       
       
     }
@@ -183,10 +235,11 @@ class Typecheck : public Visitor {
     
       //WRITE ME
       // m_symboltable->open_scope();
-      p->visit_children(this);
+      m_signatures_only = m_units && m_units->clean(((ClassIDImpl*)p->m_classid_1)->m_classname->id());
+      visit_children(p);
+      m_signatures_only = false;
 
-      char* name = strdup(p->m_classid_1->m_attribute.m_type.classType.classID);
-      p->m_attribute.m_type.classType.classID = strdup(name);
+      type_of(p).classID = type_of(p->m_classid_1).classID;
 
       // m_symboltable->close_scope();
     }
@@ -194,28 +247,28 @@ class Typecheck : public Visitor {
     void visitDeclarationImpl(DeclarationImpl *p) {
     
       //WRITE ME
-      p->visit_children(this);
+      visit_children(p);
 
-      Basetype type = p->m_type->m_attribute.m_type.baseType;
-      char* className = NULL;
+      Basetype type = type_of(p->m_type).baseType;
+      SymId className = sym_none;
       if(type == bt_object){
-        className = strdup(p->m_type->m_attribute.m_type.classType.classID);
+        className = type_of(p->m_type).classID;
       }
 
-      list<VariableID_ptr>::iterator var_i;
+      VariableID_list::iterator var_i;
       forall(var_i, p->m_variableid_list){
         Symbol *s = new Symbol();
         s->baseType = type;
-        if(className != NULL)
+        if(className != sym_none)
           s->classType.classID = className;
-        char *name = strdup((*var_i)->m_attribute.m_type.classType.classID);
+        SymId name = type_of((*var_i)).classID;
 
         // cerr << "declared: " << name << ", type: " << bt_to_string(type) << endl;
         // 6. Two properties of the same class cannot have the same name (same class var names)
         // 7. Two local variables of the same method cannot have the same name (same local var names)        
         // 8. Local variable of a method and a property of the class containing that method cannot have the same name (same class var and method var names)
         if(m_symboltable->exist(name))
-          this->t_error(dup_ident_name, p->m_attribute);
+          this->t_error(dup_ident_name, p);
         else
           m_symboltable->insert(name, s);
       }
@@ -225,26 +278,38 @@ class Typecheck : public Visitor {
     
       //WRITE ME
       m_symboltable->open_scope();
-      p->visit_children(this);
+      if(m_signatures_only){
+        // the body checked when the class was cached, and returns what
+        // the method says it does
+        dispatch(p->m_methodid);
+        Parameter_list::iterator par_i;
+        forall(par_i, p->m_parameter_list){
+          dispatch(*par_i);
+        }
+        dispatch(p->m_type);
+        type_of(p->m_methodbody) = type_of(p->m_type);
+      } else {
+        visit_children(p);
+      }
       // visitMethodIDImpl((MethodIDImpl*)p->m_methodid);
 
       Symbol *s = new Symbol();
-      char* methodName = strdup(p->m_methodid->m_attribute.m_type.classType.classID);
-      p->m_attribute.m_type.classType.classID = strdup(methodName);
+      s->methodType = &signature_of(p);
+      SymId methodName = type_of(p->m_methodid).classID;
+      type_of(p).classID = methodName;
 
-      list<Parameter_ptr>::iterator par_i;
+      Parameter_list::iterator par_i;
       forall(par_i, p->m_parameter_list){
         // visitParameterImpl((ParameterImpl*)(*par_i));
         CompoundType parameter;
-        parameter.baseType = (*par_i)->m_attribute.m_type.classType.baseType;
-        parameter.classID = (*par_i)->m_attribute.m_type.classType.classID;
+        parameter.baseType = type_of((*par_i)).baseType;
+        parameter.classID = type_of((*par_i)).classID;
 
         Symbol *s2 = m_symboltable->lookup(parameter.classID);
         s->classType.classID = s2->classType.classID;
         parameter.classID = s->classType.classID;
 
-        p->m_attribute.m_type.methodType.argsType.push_back(parameter);
-        s->methodType.argsType.push_back(parameter);
+        signature_of(p).argsType.push_back(parameter);
       }
 
       // Visit return type
@@ -254,21 +319,20 @@ class Typecheck : public Visitor {
 
       Basetype type = bt_function;
       s->baseType = type;
-      p->m_attribute.m_type.baseType = type;
+      type_of(p).baseType = type;
 
-      Basetype returnType = p->m_methodbody->m_attribute.m_type.baseType;
-      s->methodType.returnType.baseType = returnType;
-      p->m_attribute.m_type.methodType.returnType.baseType = returnType;
+      Basetype returnType = type_of(p->m_methodbody).baseType;
+      signature_of(p).returnType.baseType = returnType;
 
       // 16. Declared Return Type Must Match Type of Return Statement (error: ret_type_mismatch)
-      if(p->m_type->m_attribute.m_type.baseType != returnType){
-        // cerr << p->m_type->m_attribute.m_type.baseType << " " << returnType << endl;
-        this->t_error(ret_type_mismatch, p->m_attribute);
+      if(type_of(p->m_type).baseType != returnType){
+        // cerr << type_of(p->m_type).baseType << " " << returnType << endl;
+        this->t_error(ret_type_mismatch, p);
       }
 
       // 5. Two methods in the same class cannot have the same name
       if(m_symboltable->exist(methodName))
-        this->t_error(dup_ident_name, p->m_attribute);
+        this->t_error(dup_ident_name, p);
       else
         m_symboltable->insert_in_parent_scope(methodName, s);
 
@@ -281,18 +345,18 @@ class Typecheck : public Visitor {
     void visitMethodBodyImpl(MethodBodyImpl *p) {
     
       //WRITE ME
-      p->visit_children(this);
+      visit_children(p);
 
       // if(just_return){
       //   p->m_return->accept(this);
-        p->m_attribute.m_type.baseType = p->m_return->m_attribute.m_type.baseType;  
+        type_of(p).baseType = type_of(p->m_return).baseType;  
       // } else {
-      //   list<Declaration_ptr>::iterator dec_i;
+      //   Declaration_list::iterator dec_i;
       //   forall(dec_i, p->m_declaration_list){
       //     visitDeclarationImpl((DeclarationImpl*)*dec_i);
       //   }
 
-      //   list<Statement_ptr>::iterator stat_i;
+      //   Statement_list::iterator stat_i;
       //   forall(stat_i, p->m_statement_list){
       //     Assignment* a = ((Assignment*)*stat_i);
       //     If *i = ((If*)*stat_i);
@@ -313,35 +377,35 @@ class Typecheck : public Visitor {
       //   }
       // }
 
-      // p->m_attribute.m_type.methodType.returnType.classID = p->m_return->m_attribute.m_type;
+      // signature_of(p).returnType.classID = type_of(p->m_return).classID;
     }
     
     void visitParameterImpl(ParameterImpl *p) {
     
       //WRITE ME
-      p->visit_children(this);
+      visit_children(p);
 
-      char* paramName = strdup(p->m_variableid->m_attribute.m_type.classType.classID);
-      p->m_attribute.m_type.classType.classID = strdup(paramName);
+      SymId paramName = type_of(p->m_variableid).classID;
+      type_of(p).classID = paramName;
 
-      Basetype type = p->m_type->m_attribute.m_type.baseType;
-      p->m_attribute.m_type.classType.baseType = type;
+      Basetype type = type_of(p->m_type).baseType;
+      type_of(p).baseType = type;
 
-      char* className = NULL;
+      SymId className = sym_none;
       if(type == bt_object){
-        className = strdup(p->m_type->m_attribute.m_type.classType.classID);
+        className = type_of(p->m_type).classID;
       }
 
       Symbol *s = new Symbol();
       s->baseType = type;
-      if(className != NULL){
+      if(className != sym_none){
         s->classType.classID = className;
         // cerr << s->classType.classID << endl;
       }
 
       // 7. Two local variables of the same method cannot have the same name (same local var names)
       if(m_symboltable->exist(paramName))
-        this->t_error(dup_ident_name, p->m_attribute);
+        this->t_error(dup_ident_name, p);
       else
         m_symboltable->insert(paramName, s);
     }
@@ -349,463 +413,387 @@ class Typecheck : public Visitor {
     void visitAssignment(Assignment *p) {
     
       //WRITE ME
-      p->visit_children(this);
+      visit_children(p);
 
-      char *varName = strdup(p->m_variableid->m_attribute.m_type.classType.classID);
-      // p->m_attribute.m_type.classType.classID = strdup(varName);
+      SymId varName = type_of(p->m_variableid).classID;
+      // type_of(p).classID = varName;
       Symbol *s = m_symboltable->lookup(varName);
 
       // 9. No Usage of Undefined Variables (error: sym_name_undef)
       if(!m_symboltable->exist(varName)){
-        // TODO need access to current class name
-        char* className = strdup(current_class_name->spelling());
-        // cerr << className << endl;
-
-        ClassNode* current_class = m_classtable->lookup(className);
-
-        bool foundInParentClass = false;
-        // ClassNode
-        while( strcmp(current_class->name->spelling(), "TopClass") != 0 && current_class->scope != NULL){
-          s = current_class->scope->lookup(varName);
-          if(s != NULL){
-            foundInParentClass = true;
-            break;
-          }
-          current_class = m_classtable->getParentOf(current_class->name);
-        }
-        if(!foundInParentClass){
-          // cerr << "ASDASDASD" << endl;
-          t_error(sym_name_undef, p->m_attribute);
+        // a field the class inherits
+        s = member_of(m_classtable->lookup(current_class_name), varName);
+        if(s == NULL){
+          t_error(sym_name_undef, p);
         }
       }
 
-      p->m_attribute.m_type.baseType = s->baseType;
+      type_of(p).baseType = s->baseType;
 
       Basetype left = s->baseType;
-      Basetype right = p->m_expression->m_attribute.m_type.baseType;
+      Basetype right = type_of(p->m_expression).baseType;
 
       // cerr << "Assignment| " << varName << " " << bt_to_string(left) << " = " << bt_to_string(right) << endl;
 
       // 18. If both sides are of Object type, then the right-hand-side type may be a subclass of the left-hand-side type.
       if(left == bt_object && right == bt_object){
-        ClassNode *c = m_classtable->lookup((char*)s->classType.classID);
+        ClassNode *c = m_classtable->lookup(s->classType.classID);
         if(c == NULL){
           // cerr << "here" << endl;
-          this->t_error(sym_type_mismatch, p->m_attribute);
+          this->t_error(sym_type_mismatch, p);
         }
         // cerr << "Match? " << c->name->spelling() << endl;
 
-        char* className = strdup(p->m_expression->m_attribute.m_type.classType.classID);
+        SymId className = type_of(p->m_expression).classID;
 
-        // cerr << (char*)s->classType.classID << endl;
+        // cerr << Interner::spelling(s->classType.classID) << endl;
         ClassNode *c2 = m_classtable->lookup(className);
         if(c2 == NULL){
           // cerr << "sdfshere" << endl;
-          this->t_error(sym_type_mismatch, p->m_attribute);
+          this->t_error(sym_type_mismatch, p);
         }
         // cerr << "Subclass? " << c2->name->spelling() << endl;
-        if(strcmp(c->name->spelling(), c2->name->spelling()) != 0){
-          // if(c2->p->m_classid_2 != NULL)
-          //   cerr << " superclass: " << c2->p->m_classid_2->m_attribute.m_type.classType.classID << endl;
-
-          bool foundInParentClass = false;
-          while(c2->p->m_classid_2 != NULL){
-            if(strcmp(c->name->spelling(), (char*)c2->p->m_classid_2->m_attribute.m_type.classType.classID) == 0){
-              foundInParentClass = true;
-            }
-            c2 = m_classtable->lookup((char*)c2->p->m_classid_2->m_attribute.m_type.classType.classID);
-          }
-          if(foundInParentClass == false){
-            this->t_error(incompat_assign ,p->m_attribute);
-          }
+        if(!m_classtable->isSubclassOf(c2, c)){
+          this->t_error(incompat_assign ,p);
         }
       }
 
       // 17. In every assignment statement, the left and right hand sides must have the same type.
       // This means that the type of the left-hand-side variable and the right-hand-side expression must be equivalent.
       if(left != right){
-        this->t_error(incompat_assign, p->m_attribute);
+        this->t_error(incompat_assign, p);
       }
 
-      p->m_attribute.m_type.baseType = bt_integer;
+      type_of(p).baseType = bt_integer;
     }
     
     void visitIf(If *p) {
-      p->visit_children(this);
+      visit_children(p);
 
       // 19. If Predicate Expression Must be Bool Type (error: if_pred_err)
-      if(p->m_expression->m_attribute.m_type.baseType != bt_boolean)
-        this->t_error(if_pred_err, p->m_attribute);
+      if(type_of(p->m_expression).baseType != bt_boolean)
+        this->t_error(if_pred_err, p);
     }
     
     void visitPrint(Print *p) {
-      p->visit_children(this);
+      visit_children(p);
     }
     
     void visitReturnImpl(ReturnImpl *p) {
-      p->visit_children(this);
+      visit_children(p);
 
-      p->m_attribute.m_type.baseType = p->m_expression->m_attribute.m_type.baseType;
+      type_of(p).baseType = type_of(p->m_expression).baseType;
     }
     
     void visitTInteger(TInteger *p) {
-      p->m_attribute.m_type.baseType = bt_integer;
+      type_of(p).baseType = bt_integer;
     }
     
     void visitTBoolean(TBoolean *p) {
-      p->m_attribute.m_type.baseType = bt_boolean;
+      type_of(p).baseType = bt_boolean;
     }
     
     void visitTNothing(TNothing *p) {
-      p->m_attribute.m_type.baseType = bt_nothing;
+      type_of(p).baseType = bt_nothing;
     }
     
     void visitTObject(TObject *p) {
-      p->m_attribute.m_type.baseType = bt_object;
+      type_of(p).baseType = bt_object;
       ClassIDImpl* impl = (ClassIDImpl*) p->m_classid;
-      p->m_attribute.m_type.classType.classID = strdup(impl->m_classname->spelling());
+      type_of(p).classID = impl->m_classname->id();
     }
     
     void visitClassIDImpl(ClassIDImpl *p) {
-      p->m_attribute.m_type.classType.classID = strdup(p->m_classname->spelling());
+      type_of(p).classID = p->m_classname->id();
     }
     
     void visitVariableIDImpl(VariableIDImpl *p) {
-      p->m_attribute.m_type.classType.classID = strdup(p->m_symname->spelling());
+      type_of(p).classID = p->m_symname->id();
     }
     
     void visitMethodIDImpl(MethodIDImpl *p) {
-      p->m_attribute.m_type.classType.classID = strdup(p->m_symname->spelling());
-      p->m_attribute.m_type.baseType = bt_function;
+      type_of(p).classID = p->m_symname->id();
+      type_of(p).baseType = bt_function;
     }
     
     // 20. Addition, Subtraction, Multiplication, Division, and Unary Minus expressions must have Int operands and they all produce Int.
     void visitPlus(Plus *p) {
-      p->visit_children(this);
+      visit_children(p);
 
-      Basetype left = p->m_expression_1->m_attribute.m_type.baseType;
-      Basetype right = p->m_expression_2->m_attribute.m_type.baseType;
+      Basetype left = type_of(p->m_expression_1).baseType;
+      Basetype right = type_of(p->m_expression_2).baseType;
 
       if(left != bt_integer || right != bt_integer)
-        this->t_error(expr_type_err, p->m_attribute);
+        this->t_error(expr_type_err, p);
 
-      p->m_attribute.m_type.baseType = bt_integer;
+      type_of(p).baseType = bt_integer;
     }
     
     void visitMinus(Minus *p) {
-      p->visit_children(this);
+      visit_children(p);
 
-      Basetype left = p->m_expression_1->m_attribute.m_type.baseType;
-      Basetype right = p->m_expression_2->m_attribute.m_type.baseType;
+      Basetype left = type_of(p->m_expression_1).baseType;
+      Basetype right = type_of(p->m_expression_2).baseType;
 
       if(left != bt_integer || right != bt_integer)
-        this->t_error(expr_type_err, p->m_attribute);
+        this->t_error(expr_type_err, p);
 
-      p->m_attribute.m_type.baseType = bt_integer;
+      type_of(p).baseType = bt_integer;
     }
     
     void visitTimes(Times *p) {
-      p->visit_children(this);
+      visit_children(p);
 
-      Basetype left = p->m_expression_1->m_attribute.m_type.baseType;
-      Basetype right = p->m_expression_2->m_attribute.m_type.baseType;
+      Basetype left = type_of(p->m_expression_1).baseType;
+      Basetype right = type_of(p->m_expression_2).baseType;
 
       if(left != bt_integer || right != bt_integer)
-        this->t_error(expr_type_err, p->m_attribute);
+        this->t_error(expr_type_err, p);
 
-      p->m_attribute.m_type.baseType = bt_integer;
+      type_of(p).baseType = bt_integer;
     }
     
     void visitDivide(Divide *p) {
-      p->visit_children(this);
+      visit_children(p);
 
-      Basetype left = p->m_expression_1->m_attribute.m_type.baseType;
-      Basetype right = p->m_expression_2->m_attribute.m_type.baseType;
+      Basetype left = type_of(p->m_expression_1).baseType;
+      Basetype right = type_of(p->m_expression_2).baseType;
 
       if(left != bt_integer || right != bt_integer)
-        this->t_error(expr_type_err, p->m_attribute);
+        this->t_error(expr_type_err, p);
 
-      p->m_attribute.m_type.baseType = bt_integer;
+      type_of(p).baseType = bt_integer;
     }
     
     //  22. And and Not expressions must have Bool operands and they both produce Bool.
     void visitAnd(And *p) {
-      p->visit_children(this);
+      visit_children(p);
 
-      Basetype left = p->m_expression_1->m_attribute.m_type.baseType;
-      Basetype right = p->m_expression_2->m_attribute.m_type.baseType;
+      Basetype left = type_of(p->m_expression_1).baseType;
+      Basetype right = type_of(p->m_expression_2).baseType;
 
       if(left != bt_boolean || right != bt_boolean)
-        this->t_error(expr_type_err, p->m_attribute);
+        this->t_error(expr_type_err, p);
 
-      p->m_attribute.m_type.baseType = bt_boolean;
+      type_of(p).baseType = bt_boolean;
     }
     
     // 21. Less Than and Less or Equal to expressions must have Int operands and they both produce Bool.
     void visitLessThan(LessThan *p) {
-      p->visit_children(this);
+      visit_children(p);
 
-      Basetype left = p->m_expression_1->m_attribute.m_type.baseType;
-      Basetype right = p->m_expression_2->m_attribute.m_type.baseType;
+      Basetype left = type_of(p->m_expression_1).baseType;
+      Basetype right = type_of(p->m_expression_2).baseType;
 
       if(left != bt_integer || right != bt_integer)
-        this->t_error(expr_type_err, p->m_attribute);
+        this->t_error(expr_type_err, p);
 
-      p->m_attribute.m_type.baseType = bt_boolean;
+      type_of(p).baseType = bt_boolean;
     }
     
     void visitLessThanEqualTo(LessThanEqualTo *p) {
-      p->visit_children(this);
+      visit_children(p);
 
-      Basetype left = p->m_expression_1->m_attribute.m_type.baseType;
-      Basetype right = p->m_expression_2->m_attribute.m_type.baseType;
+      Basetype left = type_of(p->m_expression_1).baseType;
+      Basetype right = type_of(p->m_expression_2).baseType;
 
       if(left != bt_integer || right != bt_integer)
-        this->t_error(expr_type_err, p->m_attribute);
+        this->t_error(expr_type_err, p);
 
-      p->m_attribute.m_type.baseType = bt_boolean;
+      type_of(p).baseType = bt_boolean;
     }
     
     void visitNot(Not *p) {
-      p->visit_children(this);
+      visit_children(p);
 
-      if(p->m_expression->m_attribute.m_type.baseType != bt_boolean)
-        this->t_error(expr_type_err, p->m_attribute);
+      if(type_of(p->m_expression).baseType != bt_boolean)
+        this->t_error(expr_type_err, p);
 
-      p->m_attribute.m_type.baseType = bt_boolean;
+      type_of(p).baseType = bt_boolean;
     }
     
     void visitUnaryMinus(UnaryMinus *p) {
-      p->visit_children(this);
+      visit_children(p);
 
-      if(p->m_expression->m_attribute.m_type.baseType != bt_integer)
-        this->t_error(expr_type_err, p->m_attribute);
+      if(type_of(p->m_expression).baseType != bt_integer)
+        this->t_error(expr_type_err, p);
 
-      p->m_attribute.m_type.baseType = bt_integer;
+      type_of(p).baseType = bt_integer;
     }
     
     void visitMethodCall(MethodCall *p) {
     
       //WRITE ME
-      p->visit_children(this);
+      visit_children(p);
       // cerr << "method call" << endl;
 
       // 10. Identifiers which are used as method names must have the method type
-      if(p->m_methodid->m_attribute.m_type.baseType != bt_function){
-        this->t_error(sym_type_mismatch, p->m_attribute);
+      if(type_of(p->m_methodid).baseType != bt_function){
+        this->t_error(sym_type_mismatch, p);
       }
 
-      list<Expression_ptr>::iterator exp_i;
+      Expression_list::iterator exp_i;
       forall(exp_i, p->m_expression_list){
-        if((*exp_i)->m_attribute.m_type.baseType == bt_function){
-          this->t_error(sym_type_mismatch, p->m_attribute);    
+        if(type_of((*exp_i)).baseType == bt_function){
+          this->t_error(sym_type_mismatch, p);    
         }
       }
 
-      char* className = (char*)m_symboltable->lookup(p->m_variableid->m_attribute.m_type.classType.classID)->classType.classID;
-      char* methodName = strdup(p->m_methodid->m_attribute.m_type.classType.classID);
+      // the receiver is a local, a parameter or a field (maybe inherited),
+      // as in visitVariable
+      SymId varName = type_of(p->m_variableid).classID;
+      Symbol *v = m_symboltable->lookup(varName);
+      if(v == NULL)
+        v = member_of(m_classtable->lookup(current_class_name), varName);
+      // 9. No Usage of Undefined Variables (error: sym_name_undef)
+      if(v == NULL)
+        this->t_error(sym_name_undef, p);
 
-      ClassNode* current_class = m_classtable->lookup(className);
-      Symbol *s = current_class->scope->lookup(methodName);
+      SymId className = v->classType.classID;
+      SymId methodName = type_of(p->m_methodid).classID;
 
-      bool foundInParentClass = false;
-      while(strcmp(current_class->name->spelling(), "TopClass") != 0 && current_class->scope != NULL){
-        // cerr << current_class->name->spelling() << endl;
-        s = current_class->scope->lookup(methodName);
-        if(s != NULL){
-          foundInParentClass = true;
-          break;
-        }
-        current_class = m_classtable->getParentOf(current_class->name);
-      }
+      Symbol *s = member_of(m_classtable->lookup(className), methodName);
+
+      // 10. Identifiers which are used as method names must have the method type
+      if(s != NULL && s->baseType != bt_function)
+        this->t_error(sym_type_mismatch, p);
 
-      if(foundInParentClass){
-        // cerr << p->m_expression_list->size() << " " << s->methodType.argsType.size() << endl;
+      if(s != NULL){
+        // cerr << p->m_expression_list->size() << " " << s->methodType->argsType.size() << endl;
         // 14. Number of Arguments Must Match Number of Parameters (error: call_narg_mismatch)
-        if(s->methodType.argsType.size() != p->m_expression_list->size()){
-          this->t_error(call_narg_mismatch, p->m_attribute);
+        if(s->methodType->argsType.size() != p->m_expression_list->size()){
+          this->t_error(call_narg_mismatch, p);
         } else {
           // 15. Type of Arguments Must Match Type of Parameters (error: call_args_mismatch)
-          list<Expression_ptr>::iterator exp_i2;
+          Expression_list::iterator exp_i2;
           vector<CompoundType>::iterator param_i;
-          param_i = s->methodType.argsType.begin();
+          param_i = s->methodType->argsType.begin();
           forall(exp_i2, p->m_expression_list){
-            Basetype argT = (*exp_i2)->m_attribute.m_type.baseType;
+            Basetype argT = type_of((*exp_i2)).baseType;
             Basetype paramT = param_i->baseType;
 
             if(argT == bt_object && paramT == bt_object){
-              char* arg = strdup((*exp_i2)->m_attribute.m_type.classType.classID);
-              char* param = strdup(param_i->classID);
-              // cerr << arg << param << endl;
-              if(strcmp(arg, param) != 0){
-                // Loop through subclass to see if name matches param or else throw error
-                ClassNode* curr_class = m_classtable->lookup(arg);
-
-                bool foundInChildClass = false;
-                while(strcmp(curr_class->name->spelling(), "TopClass") != 0 && curr_class->scope != NULL){
-                  // cerr << curr_class->name->spelling() << endl;
-                  if(strcmp(curr_class->name->spelling(), param) == 0 ){
-                    foundInChildClass = true;
-                    break;
-                  }
-                  curr_class = m_classtable->getParentOf(curr_class->name);
-                }
-
-                if(!foundInChildClass){
-                  this->t_error(call_args_mismatch, p->m_attribute);
-                }
+              SymId arg = type_of((*exp_i2)).classID;
+              SymId param = param_i->classID;
+              // cerr << Interner::spelling(arg) << Interner::spelling(param) << endl;
+              // the argument may be of a subclass of the parameter's class
+              if(!m_classtable->isSubclassOf(arg, param)){
+                this->t_error(call_args_mismatch, p);
               }
             } else if(argT != paramT){
-              this->t_error(call_args_mismatch, p->m_attribute);          
+              this->t_error(call_args_mismatch, p);          
             }
             param_i++;
           }
-          // cerr << "Method call return: " << s->methodType.returnType.baseType << endl;
-          p->m_attribute.m_type.baseType = s->methodType.returnType.baseType;
-          // cerr << "Method Call RT: " << p->m_attribute.m_type.baseType << endl;
+          // cerr << "Method call return: " << s->methodType->returnType.baseType << endl;
+          type_of(p).baseType = s->methodType->returnType.baseType;
+          // cerr << "Method Call RT: " << type_of(p).baseType << endl;
         }
       } else {
         // 24. Called Methods Must Exist on Receiver Object (error: no_class_method)
-        this->t_error(no_class_method, p->m_attribute);
+        this->t_error(no_class_method, p);
       }
     }
     
     void visitSelfCall(SelfCall *p) {
     
       //WRITE ME
-      p->visit_children(this);
+      visit_children(p);
       // cerr << "self call" << endl;
 
       // 10. Identifiers which are used as method names must have the method type
-      if(p->m_methodid->m_attribute.m_type.baseType != bt_function){
+      if(type_of(p->m_methodid).baseType != bt_function){
         // cerr << "aasdfsdfsdfaa" << endl;
-        this->t_error(sym_type_mismatch, p->m_attribute);
+        this->t_error(sym_type_mismatch, p);
       }
 
-      list<Expression_ptr>::iterator exp_i;
+      Expression_list::iterator exp_i;
       forall(exp_i, p->m_expression_list){
-        if((*exp_i)->m_attribute.m_type.baseType == bt_function){
+        if(type_of((*exp_i)).baseType == bt_function){
           // cerr << "asdf23wdf" << endl;
-          this->t_error(sym_type_mismatch, p->m_attribute);       
-        }
-      }
-      char* methodName = strdup(p->m_methodid->m_attribute.m_type.classType.classID);
-
-      ClassNode* current_class = m_classtable->lookup(current_class_name);
-      Symbol *s = current_class->scope->lookup(methodName);
-
-      bool foundInParentClass = false;
-      while(strcmp(current_class->name->spelling(), "TopClass") != 0 && current_class->scope != NULL){
-        // cerr << current_class->name->spelling() << endl;
-        s = current_class->scope->lookup(methodName);
-        if(s != NULL){
-          foundInParentClass = true;
-          break;
+          this->t_error(sym_type_mismatch, p);       
         }
-        current_class = m_classtable->getParentOf(current_class->name);
       }
+      SymId methodName = type_of(p->m_methodid).classID;
 
-      if(foundInParentClass){
-        // cerr << p->m_expression_list->size() << " " << s->methodType.argsType.size() << endl;
+      Symbol *s = member_of(m_classtable->lookup(current_class_name), methodName);
+
+      // 10. Identifiers which are used as method names must have the method type
+      if(s != NULL && s->baseType != bt_function)
+        this->t_error(sym_type_mismatch, p);
+
+      if(s != NULL){
+        // cerr << p->m_expression_list->size() << " " << s->methodType->argsType.size() << endl;
         // 14. Number of Arguments Must Match Number of Parameters (error: call_narg_mismatch)
-        if(s->methodType.argsType.size() != p->m_expression_list->size()){
-          this->t_error(call_narg_mismatch, p->m_attribute);
+        if(s->methodType->argsType.size() != p->m_expression_list->size()){
+          this->t_error(call_narg_mismatch, p);
         } else {
           // 15. Type of Arguments Must Match Type of Parameters (error: call_args_mismatch)
-          list<Expression_ptr>::iterator exp_i2;
+          Expression_list::iterator exp_i2;
           vector<CompoundType>::iterator param_i;
-          param_i = s->methodType.argsType.begin();
+          param_i = s->methodType->argsType.begin();
           forall(exp_i2, p->m_expression_list){
-            Basetype argT = (*exp_i2)->m_attribute.m_type.baseType;
+            Basetype argT = type_of((*exp_i2)).baseType;
             Basetype paramT = param_i->baseType;
 
             if(argT == bt_object && paramT == bt_object){
-              char* arg = strdup((*exp_i2)->m_attribute.m_type.classType.classID);
-              char* param = strdup(param_i->classID);
-              // cerr << arg << param << endl;
-              if(strcmp(arg, param) != 0){
-                // Loop through subclass to see if name matches param or else throw error
-                ClassNode* curr_class = m_classtable->lookup(arg);
-
-                bool foundInChildClass = false;
-                while(strcmp(curr_class->name->spelling(), "TopClass") != 0 && current_class->scope != NULL){
-                  // cerr << curr_class->name->spelling() << endl;
-                  if(strcmp(curr_class->name->spelling(), param) == 0 ){
-                    foundInChildClass = true;
-                    break;
-                  }
-                  curr_class = m_classtable->getParentOf(curr_class->name);
-                }
-
-                if(!foundInChildClass){
-                  this->t_error(call_args_mismatch, p->m_attribute);
-                }
+              SymId arg = type_of((*exp_i2)).classID;
+              SymId param = param_i->classID;
+              // cerr << Interner::spelling(arg) << Interner::spelling(param) << endl;
+              // the argument may be of a subclass of the parameter's class
+              if(!m_classtable->isSubclassOf(arg, param)){
+                this->t_error(call_args_mismatch, p);
               }
             } else if(argT != paramT){
-              this->t_error(call_args_mismatch, p->m_attribute);          
+              this->t_error(call_args_mismatch, p);          
             }
             param_i++;
           }
-          // cerr << "Method call return: " << s->methodType.returnType.baseType << endl;
-          p->m_attribute.m_type.baseType = s->methodType.returnType.baseType;
+          // cerr << "Method call return: " << s->methodType->returnType.baseType << endl;
+          type_of(p).baseType = s->methodType->returnType.baseType;
         }
       } else {
         // 24. Called Methods Must Exist on Receiver Object (error: no_class_method)
-        this->t_error(no_class_method, p->m_attribute);
+        this->t_error(no_class_method, p);
       }
     }
     
     void visitVariable(Variable *p) {
-      p->visit_children(this);
+      visit_children(p);
 
-      char *varName = strdup(p->m_variableid->m_attribute.m_type.classType.classID);
-      p->m_attribute.m_type.classType.classID = strdup(varName);
+      SymId varName = type_of(p->m_variableid).classID;
+      type_of(p).classID = varName;
 
       // 9. No Usage of Undefined Variables (error: sym_name_undef)
       // TODO check parent classes
       Symbol *s;
       if(!m_symboltable->exist(varName)){
-        char* className = strdup(current_class_name->spelling());
-        // cerr << className << endl;
-
-        ClassNode* current_class = m_classtable->lookup(className);
-
-        bool foundInParentClass = false;
-        // ClassNode
-        while( strcmp(current_class->name->spelling(), "TopClass") != 0 && current_class->scope != NULL){
-          s = current_class->scope->lookup(varName);
-          if(s != NULL){
-            foundInParentClass = true;
-            break;
-          }
-          // m_classtable->getParentOf(current_class->name);
-          current_class = m_classtable->getParentOf(current_class->name);
-        }
-        if(!foundInParentClass){
-          // cerr << "ASDASDASD" << endl;
-          t_error(sym_name_undef, p->m_attribute);
+        // a field the class inherits
+        s = member_of(m_classtable->lookup(current_class_name), varName);
+        if(s == NULL){
+          t_error(sym_name_undef, p);
         }
       } else {
         s = m_symboltable->lookup(varName);  
       }
 
       
-      p->m_attribute.m_type.baseType = s->baseType;
-      p->m_attribute.m_type.classType.classID = s->classType.classID;
-      // cerr << "visitVariable: " << varName << ", type: "<< bt_to_string(p->m_attribute.m_type.baseType) << endl;
+      type_of(p).baseType = s->baseType;
+      type_of(p).classID = s->classType.classID;
+      // cerr << "visitVariable: " << varName << ", type: "<< bt_to_string(type_of(p).baseType) << endl;
     }
     
     // 23. Integer literals are of type Int and boolean literals are of type Bool.
     void visitIntegerLiteral(IntegerLiteral *p) {
-      p->m_attribute.m_type.baseType = bt_integer;
+      type_of(p).baseType = bt_integer;
     }
     
     void visitBooleanLiteral(BooleanLiteral *p) {
-      p->m_attribute.m_type.baseType = bt_boolean;
+      type_of(p).baseType = bt_boolean;
     }
     
     void visitNothing(Nothing *p) {
-      p->m_attribute.m_type.baseType = bt_nothing;
+      type_of(p).baseType = bt_nothing;
     }
     
     void visitSymName(SymName *p) {}